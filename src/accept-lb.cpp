@@ -0,0 +1,267 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "accept-lb.hpp"
+#include "worker-thread.hpp"
+#include "api/bpf.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+
+namespace pipy {
+
+//
+// AcceptLoadBalancer
+//
+// Every worker thread owns a slot with its live connection count,
+// the number of connections handed to it but not yet adopted and
+// the latest event-loop lag, i.e. the delay between posting a probe
+// to its Net and the probe being run. A thread accepting a connection
+// keeps it unless another thread is cheaper by more than MARGIN, so that
+// evenly loaded threads never ping-pong sockets between each other.
+//
+
+static const double PROBE_INTERVAL = 50;  // milliseconds
+static const double LAG_UNIT = 10;        // milliseconds
+static const double MARGIN = 2;
+
+static const double SELECT_INTERVAL = 5;  // milliseconds
+
+static std::map<std::string, std::unique_ptr<bpf::ReusePortSelector>> s_selectors;
+static std::mutex s_selectors_mutex;
+static uint32_t s_table[bpf::ReusePortSelector::TABLE_SIZE];
+static bool s_table_ready = false;
+
+std::atomic<AcceptLoadBalancer::Mode> AcceptLoadBalancer::s_mode(AcceptLoadBalancer::Mode::OFF);
+std::atomic<int> AcceptLoadBalancer::s_num_slots(0);
+std::atomic<double> AcceptLoadBalancer::s_last_probe(0);
+std::atomic<double> AcceptLoadBalancer::s_last_select(0);
+AcceptLoadBalancer::Slot AcceptLoadBalancer::s_slots[MAX_THREADS];
+thread_local int AcceptLoadBalancer::s_current = -1;
+
+auto AcceptLoadBalancer::now() -> double {
+  auto t = std::chrono::steady_clock::now().time_since_epoch();
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+  return us / 1000.0;
+}
+
+void AcceptLoadBalancer::register_thread(int index) {
+  if (index < 0 || index >= MAX_THREADS) return;
+  auto &slot = s_slots[index];
+  slot.connections.store(0);
+  slot.pending.store(0);
+  slot.lag.store(0);
+  slot.probing.store(0);
+  {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.net.store(&Net::current());
+  }
+  auto n = s_num_slots.load();
+  while (n <= index && !s_num_slots.compare_exchange_weak(n, index + 1)) {}
+  s_current = index;
+}
+
+void AcceptLoadBalancer::unregister_thread() {
+  if (s_current < 0) return;
+  auto &slot = s_slots[s_current];
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  slot.net.store(nullptr);
+  s_current = -1;
+}
+
+auto AcceptLoadBalancer::load() -> Load {
+  Load load = { s_current, 0, 0, 0, 0 };
+  if (s_current >= 0) {
+    auto &slot = s_slots[s_current];
+    load.connections = slot.connections.load();
+    load.lag = slot.lag.load();
+    load.handoffs_in = slot.handoffs_in.load();
+    load.handoffs_out = slot.handoffs_out.load();
+  }
+  return load;
+}
+
+void AcceptLoadBalancer::measure(int index, double posted) {
+  if (index < 0 || index >= MAX_THREADS) return;
+  s_slots[index].lag.store(now() - posted);
+}
+
+void AcceptLoadBalancer::update(int connections) {
+  if (s_current < 0) return;
+  s_slots[s_current].connections.store(connections);
+  if (mode() == Mode::EBPF) select(now());
+}
+
+auto AcceptLoadBalancer::pick() -> int {
+  if (s_current < 0) return -1;
+  auto t = now();
+  probe(t);
+  auto own = cost(s_slots[s_current], t);
+  auto best = -1;
+  auto best_cost = own;
+  auto n = s_num_slots.load();
+  for (int i = 0; i < n; i++) {
+    if (i == s_current) continue;
+    auto c = cost(s_slots[i], t);
+    if (c < best_cost) {
+      best = i;
+      best_cost = c;
+    }
+  }
+  if (best >= 0 && own - best_cost > MARGIN) return best;
+  return -1;
+}
+
+bool AcceptLoadBalancer::post(int index, const std::function<void()> &cb) {
+  if (index < 0 || index >= MAX_THREADS) return false;
+  auto &slot = s_slots[index];
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  auto *net = slot.net.load();
+  if (!net) return false;
+  net->post(cb);
+  return true;
+}
+
+void AcceptLoadBalancer::handed_off(int index) {
+  s_slots[index].pending.fetch_add(1);
+  if (s_current >= 0) s_slots[s_current].handoffs_out.fetch_add(1);
+}
+
+void AcceptLoadBalancer::handed_in() {
+  if (s_current < 0) return;
+  auto &slot = s_slots[s_current];
+  if (slot.pending.fetch_sub(1) <= 0) slot.pending.fetch_add(1);
+  slot.handoffs_in.fetch_add(1);
+}
+
+void AcceptLoadBalancer::attach(const std::string &ip, int port, int sock) {
+  auto wt = WorkerThread::current();
+  auto index = wt ? wt->index() : 0;
+  if (index >= MAX_THREADS) return;
+  std::lock_guard<std::mutex> lock(s_selectors_mutex);
+  auto &selector = s_selectors[ip + ':' + std::to_string(port)];
+  try {
+    if (!selector) {
+      auto n = std::max(1, std::min(WorkerManager::get().concurrency(), int(MAX_THREADS)));
+      selector.reset(new bpf::ReusePortSelector(n));
+      if (s_table_ready) selector->select(s_table);
+    }
+    selector->add(index, sock);
+    selector->attach(sock);
+  } catch (std::runtime_error &err) {
+    Log::warn(
+      "[listener] Cannot attach eBPF accept balancer to port %d at %s: %s, falling back to handoff",
+      port, ip.c_str(), err.what()
+    );
+    selector.reset();
+    s_mode.store(Mode::HANDOFF);
+  }
+}
+
+auto AcceptLoadBalancer::cost(Slot &slot, double now) -> double {
+  if (!slot.net.load(std::memory_order_relaxed)) return std::numeric_limits<double>::infinity();
+  auto lag = slot.lag.load(std::memory_order_relaxed);
+  auto probing = slot.probing.load(std::memory_order_relaxed);
+  if (probing > 0) lag = std::max(lag, now - probing);
+  auto n = slot.connections.load(std::memory_order_relaxed) + slot.pending.load(std::memory_order_relaxed);
+  return (n + 1) * (1 + lag / LAG_UNIT);
+}
+
+void AcceptLoadBalancer::probe(double now) {
+  auto last = s_last_probe.load();
+  if (now - last < PROBE_INTERVAL) return;
+  if (!s_last_probe.compare_exchange_strong(last, now)) return;
+  auto n = s_num_slots.load();
+  for (int i = 0; i < n; i++) {
+    auto &slot = s_slots[i];
+    double idle = 0;
+    if (slot.probing.compare_exchange_strong(idle, now)) {
+      auto posted = now;
+      if (!post(i, [=]() {
+        auto &slot = s_slots[i];
+        measure(i, posted);
+        slot.probing.store(0);
+      })) {
+        slot.probing.store(0);
+      }
+    }
+  }
+}
+
+//
+// In eBPF mode the kernel does the placement, so instead of picking
+// one thread per connection the table of socket indices is filled
+// with every live thread in proportion to the inverse of its cost
+//
+
+void AcceptLoadBalancer::select(double now) {
+  auto last = s_last_select.load();
+  if (now - last < SELECT_INTERVAL) return;
+  if (!s_last_select.compare_exchange_strong(last, now)) return;
+  probe(now);
+
+  static const int N = bpf::ReusePortSelector::TABLE_SIZE;
+  double weights[MAX_THREADS];
+  double total = 0;
+  auto n = s_num_slots.load();
+  for (int i = 0; i < n; i++) {
+    auto c = cost(s_slots[i], now);
+    weights[i] = std::isinf(c) ? 0 : 1 / c;
+    total += weights[i];
+  }
+  if (total <= 0) return;
+
+  uint32_t table[N];
+  double acc = 0;
+  int k = 0;
+  for (int i = 0; i < n && k < N; i++) {
+    acc += weights[i] / total * N;
+    while (k < N && k < int(acc + 0.5)) table[k++] = i;
+  }
+  while (k < N) table[k++] = n - 1;
+
+  std::unique_lock<std::mutex> lock(s_selectors_mutex, std::try_to_lock);
+  if (!lock.owns_lock()) return;
+  if (s_table_ready && !std::memcmp(table, s_table, sizeof(table))) return;
+  std::memcpy(s_table, table, sizeof(table));
+  s_table_ready = true;
+  for (const auto &p : s_selectors) {
+    if (auto *selector = p.second.get()) {
+      try {
+        selector->select(table);
+      } catch (std::runtime_error &err) {
+        Log::error("[listener] Cannot update eBPF accept balancer: %s", err.what());
+      }
+    }
+  }
+}
+
+} // namespace pipy
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ACCEPT_LB_HPP
+#define ACCEPT_LB_HPP
+
+#include "net.hpp"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace pipy {
+
+//
+// AcceptLoadBalancer
+//
+
+class AcceptLoadBalancer {
+public:
+  enum class Mode {
+    OFF,
+    HANDOFF,
+    EBPF,
+  };
+
+  struct Load {
+    int index;
+    int connections;
+    double lag;
+    uint64_t handoffs_in;
+    uint64_t handoffs_out;
+  };
+
+  static const int MAX_THREADS = 256;
+
+  static void set_mode(Mode mode) { s_mode.store(mode); }
+  static auto mode() -> Mode { return s_mode.load(std::memory_order_relaxed); }
+  static auto now() -> double;
+  static void register_thread(int index);
+  static void unregister_thread();
+  static auto load() -> Load;
+  static void measure(int index, double posted);
+  static void update(int connections);
+  static auto pick() -> int;
+  static bool post(int index, const std::function<void()> &cb);
+  static void handed_off(int index);
+  static void handed_in();
+  static void attach(const std::string &ip, int port, int sock);
+
+private:
+  struct Slot {
+    std::atomic<Net*> net;
+    std::atomic<int> connections;
+    std::atomic<int> pending;
+    std::atomic<double> lag;
+    std::atomic<double> probing;
+    std::atomic<uint64_t> handoffs_in;
+    std::atomic<uint64_t> handoffs_out;
+    std::mutex mutex;
+  };
+
+  static std::atomic<Mode> s_mode;
+  static std::atomic<int> s_num_slots;
+  static std::atomic<double> s_last_probe;
+  static std::atomic<double> s_last_select;
+  static Slot s_slots[MAX_THREADS];
+  thread_local static int s_current;
+
+  static auto cost(Slot &slot, double now) -> double;
+  static void probe(double now);
+  static void select(double now);
+};
+
+} // namespace pipy
+
+#endif // ACCEPT_LB_HPP
@@ -616,6 +616,8 @@ Message* AdminService::dump_GET(const std::string &path) {
         status.dump_inbound(db);
       } else if (item == "outbound") {
         status.dump_outbound(db);
+      } else if (item == "threads") {
+        status.dump_threads(db);
       } else {
         db.push("Unknown dump item: ");
         db.push(item);
@@ -29,6 +29,9 @@
 #include "log.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
 
 namespace pipy {
 namespace algo {
@@ -663,6 +666,10 @@ LoadBalancer::Options::Options(pjs::Object *options) {
     .get(capacity)
     .get(capacity_f)
     .check_nullable();
+  Value(options, "latencyDecay")
+    .get_seconds(latency_decay)
+    .check_nullable();
+  if (latency_decay <= 0) throw std::runtime_error("options.latencyDecay must be greater than zero");
 }
 
 void LoadBalancer::provision(pjs::Context &ctx, pjs::Array *targets) {
@@ -704,6 +711,7 @@ void LoadBalancer::provision(pjs::Context &ctx, pjs::Array *targets) {
 
         p->weight = std::max(0.0, weight.is_undefined() ? 1.0 : weight.to_number());
         p->capacity = capacity.is_undefined() ? 0 : capacity.to_int32();
+        p->latency_decay = (m_options.algorithm == PEAK_EWMA ? m_options.latency_decay : 0);
 
         return true;
       }
@@ -731,6 +739,8 @@ void LoadBalancer::provision(pjs::Context &ctx, pjs::Array *targets) {
       p->load = p->step;
       sort_forward(m_queue, p);
     }
+  } else if (m_options.algorithm == POWER_OF_TWO || m_options.algorithm == PEAK_EWMA) {
+    build_aliases();
   }
 }
 
@@ -780,6 +790,9 @@ auto LoadBalancer::allocate(pjs::Context &ctx, const pjs::Value &key, pjs::Funct
 }
 
 auto LoadBalancer::next(const std::function<bool(const pjs::Value &)> &validator) -> Pool* {
+  if (m_options.algorithm == POWER_OF_TWO || m_options.algorithm == PEAK_EWMA) {
+    return pick(validator);
+  }
   pjs::Value val;
   for (auto p = m_queue.head(); p; p = p->next()) {
     if (p->weight > 0 && (!validator || validator(p->target))) {
@@ -790,6 +803,109 @@ auto LoadBalancer::next(const std::function<bool(const pjs::Value &)> &validator
   return nullptr;
 }
 
+//
+// Power of two choices: sample two targets by weight and
+// take the one with less outstanding work, or with peak EWMA,
+// less outstanding work scaled by its recent latency
+//
+
+static auto steady_time() -> double {
+  auto t = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(t).count() / 1e6;
+}
+
+thread_local static std::minstd_rand s_lb_rand(
+  std::chrono::steady_clock::now().time_since_epoch().count()
+);
+
+auto LoadBalancer::pick(const std::function<bool(const pjs::Value &)> &validator) -> Pool* {
+  auto n = int(m_pools.size());
+  if (!n || m_aliases.empty()) return nullptr;
+
+  auto now = (m_options.algorithm == PEAK_EWMA ? steady_time() : 0);
+  auto usable = [&](Pool *p) {
+    return p->weight > 0 && (!validator || validator(p->target));
+  };
+
+  auto i = sample();
+  auto j = sample();
+  for (int retries = 0; i == j && retries < 3; retries++) j = sample();
+
+  Pool *a = m_pools[i];
+  Pool *b = (i == j ? nullptr : m_pools[j].get());
+  if (!usable(a)) a = nullptr;
+  if (b && !usable(b)) b = nullptr;
+
+  // Both samples rejected by the validator, so look through the rest
+  if (!a && !b) {
+    double min = 0;
+    for (const auto &p : m_pools) {
+      if (usable(p)) {
+        auto c = cost(p, now);
+        if (!a || c < min) {
+          a = p;
+          min = c;
+        }
+      }
+    }
+  } else if (!a || (b && cost(b, now) < cost(a, now))) {
+    a = b;
+  }
+
+  return a;
+}
+
+auto LoadBalancer::sample() -> int {
+  auto n = m_aliases.size();
+  auto i = s_lb_rand() % n;
+  auto r = double(s_lb_rand() - s_lb_rand.min()) / double(s_lb_rand.max() - s_lb_rand.min());
+  return r < m_alias_probs[i] ? i : m_aliases[i];
+}
+
+auto LoadBalancer::cost(Pool *pool, double now) const -> double {
+  if (m_options.algorithm == PEAK_EWMA) {
+    return (pool->peak_latency(now) + 0.001) * (pool->active + 1) / pool->weight;
+  } else {
+    return pool->active / pool->weight;
+  }
+}
+
+// Vose's alias method for O(1) sampling by weight
+void LoadBalancer::build_aliases() {
+  auto n = m_pools.size();
+  double total = 0;
+  for (const auto &p : m_pools) total += p->weight;
+
+  m_alias_probs.assign(n, 0);
+  m_aliases.assign(n, 0);
+  if (!n || total <= 0) {
+    m_aliases.clear();
+    return;
+  }
+
+  std::vector<int> small, large;
+  for (size_t i = 0; i < n; i++) {
+    auto p = m_alias_probs[i] = m_pools[i]->weight * n / total;
+    m_aliases[i] = i;
+    (p < 1 ? small : large).push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    auto s = small.back(); small.pop_back();
+    auto l = large.back();
+    m_aliases[s] = l;
+    auto &p = m_alias_probs[l];
+    p -= 1 - m_alias_probs[s];
+    if (p < 1) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  for (auto i : large) m_alias_probs[i] = 1;
+  for (auto i : small) m_alias_probs[i] = 1;
+}
+
 void LoadBalancer::increase_load(Pool *pool) {
   pool->load += pool->step;
   sort_forward(m_queue, pool);
@@ -839,16 +955,39 @@ auto LoadBalancer::Pool::allocate() -> Resource* {
     m_resources.unshift(r);
   }
   r->increase_load();
+  active++;
   return r;
 }
 
+auto LoadBalancer::Pool::peak_latency(double now) const -> double {
+  if (latency <= 0) return 0;
+  return latency * std::exp((latency_time - now) / latency_decay);
+}
+
+void LoadBalancer::Pool::update_latency(double now, double sample) {
+  if (sample > latency) {
+    latency = sample;
+  } else {
+    auto w = std::exp((latency_time - now) / latency_decay);
+    latency = latency * w + sample * (1 - w);
+  }
+  latency_time = now;
+}
+
 LoadBalancer::Resource::~Resource() {
+  m_pool->active -= m_load;
   m_pool->m_resources.remove(this);
 }
 
 void LoadBalancer::Resource::free() {
   if (m_load > 0) {
     m_load--;
+    m_pool->active--;
+    if (!m_start_times.empty()) {
+      auto now = steady_time();
+      m_pool->update_latency(now, now - m_start_times.front());
+      m_start_times.pop_front();
+    }
     if (auto r = back()) {
       while (r && r->m_load > m_load) {
         r = r->back();
@@ -868,6 +1007,7 @@ void LoadBalancer::Resource::free() {
 
 void LoadBalancer::Resource::increase_load() {
   m_load++;
+  if (m_pool->latency_decay > 0) m_start_times.push_back(steady_time());
   if (auto r = next()) {
     while (r && r->m_load <= m_load) {
       r = r->next();
@@ -984,9 +1124,58 @@ void LoadBalancerBase::Session::on_weak_ptr_gone() {
 // HashingLoadBalancer
 //
 
-HashingLoadBalancer::HashingLoadBalancer(pjs::Object *targets, Cache *unhealthy)
+static inline uint64_t hash_mix(uint64_t h) {
+  h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27; h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h;
+}
+
+static inline uint64_t hash_str(const std::string &s) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (auto c : s) {
+    h ^= uint8_t(c);
+    h *= 0x100000001b3ull;
+  }
+  return hash_mix(h);
+}
+
+static auto next_prime(uint64_t n) -> uint64_t {
+  if (n <= 2) return 2;
+  if (!(n & 1)) n++;
+  for (;; n += 2) {
+    bool is_prime = true;
+    for (uint64_t i = 3; i * i <= n; i += 2) {
+      if (n % i == 0) {
+        is_prime = false;
+        break;
+      }
+    }
+    if (is_prime) return n;
+  }
+}
+
+HashingLoadBalancer::Options::Options(pjs::Object *options) {
+  Value(options, "algorithm")
+    .get_enum<HashingLoadBalancer::Algorithm>(algorithm)
+    .check_nullable();
+  Value(options, "virtualNodes")
+    .get(virtual_nodes)
+    .check_nullable();
+  Value(options, "tableSize")
+    .get(table_size)
+    .check_nullable();
+  if (virtual_nodes < 1) throw std::runtime_error("options.virtualNodes must be greater than zero");
+  if (table_size < 1) throw std::runtime_error("options.tableSize must be greater than zero");
+}
+
+HashingLoadBalancer::HashingLoadBalancer(pjs::Object *targets, Cache *unhealthy, const Options &options)
   : pjs::ObjectTemplate<HashingLoadBalancer, LoadBalancerBase>(unhealthy)
+  , m_options(options)
 {
+  if (m_options.algorithm == MAGLEV) {
+    m_options.table_size = next_prime(m_options.table_size);
+  }
   set(targets);
 }
 
@@ -996,36 +1185,187 @@ HashingLoadBalancer::~HashingLoadBalancer()
 
 void HashingLoadBalancer::set(pjs::Object *targets) {
   if (targets) {
-    m_targets.clear();
+    std::vector<std::pair<pjs::Ref<pjs::Str>, double>> list;
     if (targets->is_array()) {
       targets->as<pjs::Array>()->iterate_all(
-        [this](pjs::Value &v, int i) {
+        [&](pjs::Value &v, int i) {
           auto s = v.to_string();
-          m_targets.push_back(s);
+          list.emplace_back(s, 1);
           s->release();
         }
       );
     } else {
       targets->iterate_all(
-        [this](pjs::Str *k, pjs::Value &) {
-          m_targets.push_back(k);
+        [&](pjs::Str *k, pjs::Value &v) {
+          list.emplace_back(k, v.is_number() ? v.n() : 1);
         }
       );
     }
+    update(list);
   }
 }
 
-void HashingLoadBalancer::add(pjs::Str *target) {
-  m_targets.push_back(target);
+void HashingLoadBalancer::add(pjs::Str *target, double weight) {
+  if (m_options.algorithm == MODULO) {
+    m_targets.push_back(target);
+  } else {
+    std::vector<std::pair<pjs::Ref<pjs::Str>, double>> list;
+    for (const auto &t : m_targets) list.emplace_back(t, m_target_map[t.get()].weight);
+    list.emplace_back(target, weight);
+    update(list);
+  }
+}
+
+// Both the ring and the Maglev table are walked onwards from where
+// the key lands until a healthy target shows up, so keys of a failed
+// target spread over the rest without moving any other keys
+template<class At>
+auto HashingLoadBalancer::walk(size_t i, size_t n, Cache *unhealthy, const At &at) -> pjs::Str* {
+  auto s = at(i);
+  if (is_healthy(s, unhealthy)) return s;
+
+  pjs::vl_array<pjs::Str*, 64> failed(m_target_map.size());
+  size_t failed_count = 0;
+  failed[failed_count++] = s;
+  for (size_t k = 1; k < n && failed_count < failed.size(); k++) {
+    i = (i + 1 == n ? 0 : i + 1);
+    s = at(i);
+    if (std::find(failed + 0, failed + failed_count, s) != failed + failed_count) continue;
+    if (is_healthy(s, unhealthy)) return s;
+    failed[failed_count++] = s;
+  }
+  return nullptr;
 }
 
 auto HashingLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* {
   if (m_targets.empty()) return nullptr;
   std::hash<pjs::Value> hash;
   auto h = hash(key);
-  auto s = m_targets[h % m_targets.size()].get();
-  if (s && !is_healthy(s, unhealthy)) return nullptr;
-  return s;
+
+  if (m_options.algorithm == MODULO) {
+    auto s = m_targets[h % m_targets.size()].get();
+    if (s && !is_healthy(s, unhealthy)) return nullptr;
+    return s;
+  }
+
+  auto x = hash_mix(h);
+
+  if (m_options.algorithm == RING) {
+    if (m_ring.empty()) return nullptr;
+    auto p = std::lower_bound(
+      m_ring.begin(), m_ring.end(), x,
+      [](const std::pair<uint64_t, pjs::Str*> &a, uint64_t b) { return a.first < b; }
+    );
+    auto i = (p == m_ring.end() ? 0 : p - m_ring.begin());
+    return walk(i, m_ring.size(), unhealthy, [this](size_t i) { return m_ring[i].second; });
+  } else {
+    if (m_maglev.empty()) return nullptr;
+    return walk(x % m_maglev.size(), m_maglev.size(), unhealthy, [this](size_t i) { return m_maglev[i]; });
+  }
+}
+
+void HashingLoadBalancer::update(const std::vector<std::pair<pjs::Ref<pjs::Str>, double>> &targets) {
+  m_targets.clear();
+
+  if (m_options.algorithm == MODULO) {
+    for (const auto &t : targets) m_targets.push_back(t.first);
+    return;
+  }
+
+  std::map<pjs::Str*, Target> target_map;
+  std::set<pjs::Str*> kept;
+  std::vector<std::pair<uint64_t, pjs::Str*>> new_points;
+
+  for (const auto &t : targets) {
+    auto id = t.first.get();
+    auto weight = std::min(t.second, double(MAX_WEIGHT));
+    if (!(weight > 0) || target_map.count(id)) continue;
+    m_targets.push_back(id);
+    auto i = m_target_map.find(id);
+    if (i != m_target_map.end() && i->second.weight == weight) {
+      target_map[id] = std::move(i->second);
+      kept.insert(id);
+    } else {
+      auto &target = target_map[id];
+      target.id = id;
+      target.weight = weight;
+      init_target(target);
+      for (auto p : target.points) new_points.emplace_back(p, id);
+    }
+  }
+
+  m_target_map = std::move(target_map);
+
+  if (m_options.algorithm == RING) {
+    std::vector<std::pair<uint64_t, pjs::Str*>> ring;
+    ring.reserve(m_ring.size() + new_points.size());
+    for (const auto &p : m_ring) {
+      if (kept.count(p.second)) ring.push_back(p);
+    }
+    std::sort(new_points.begin(), new_points.end());
+    m_ring.clear();
+    m_ring.reserve(ring.size() + new_points.size());
+    std::merge(
+      ring.begin(), ring.end(),
+      new_points.begin(), new_points.end(),
+      std::back_inserter(m_ring)
+    );
+  } else {
+    build_maglev();
+  }
+}
+
+void HashingLoadBalancer::init_target(Target &target) {
+  auto h = hash_str(target.id->str());
+  if (m_options.algorithm == RING) {
+    auto n = int(std::max(1.0, std::min(double(MAX_POINTS), m_options.virtual_nodes * target.weight + 0.5)));
+    target.points.resize(n);
+    for (int i = 0; i < n; i++) {
+      target.points[i] = hash_mix(h + (i + 1) * 0x9e3779b97f4a7c15ull);
+    }
+  } else {
+    uint64_t m = m_options.table_size;
+    target.offset = hash_mix(h ^ 0x5bd1e9955bd1e995ull) % m;
+    target.skip = (m > 1 ? hash_mix(h ^ 0xc2b2ae3d27d4eb4full) % (m - 1) + 1 : 1);
+  }
+}
+
+void HashingLoadBalancer::build_maglev() {
+  m_maglev.clear();
+  if (m_target_map.empty()) return;
+
+  // Fill in name order so the result does not depend on the
+  // order targets are given in
+  std::vector<Target*> targets;
+  for (auto &p : m_target_map) targets.push_back(&p.second);
+  std::sort(
+    targets.begin(), targets.end(),
+    [](const Target *a, const Target *b) { return a->id->str() < b->id->str(); }
+  );
+
+  double max_weight = 0;
+  for (auto *t : targets) max_weight = std::max(max_weight, t->weight);
+
+  // Each round, a target claims its next preferred free slot once
+  // its accumulated weight reaches the largest weight
+  size_t m = m_options.table_size;
+  size_t n = targets.size();
+  std::vector<uint64_t> next(n, 0);
+  std::vector<double> credit(n, 0);
+  m_maglev.assign(m, nullptr);
+  for (size_t filled = 0; filled < m;) {
+    for (size_t i = 0; i < n && filled < m; i++) {
+      auto *t = targets[i];
+      credit[i] += t->weight;
+      if (credit[i] < max_weight) continue;
+      credit[i] -= max_weight;
+      auto c = (t->offset + next[i] * t->skip) % m;
+      while (m_maglev[c]) c = (t->offset + ++next[i] * t->skip) % m;
+      m_maglev[c] = t->id;
+      next[i]++;
+      filled++;
+    }
+  }
 }
 
 //
@@ -1365,6 +1705,45 @@ void ResourcePool::free(const pjs::Value &resource) {
 // Percentile
 //
 
+Percentile::Options::Options(pjs::Object *options) {
+  Value(options, "min")
+    .get(min)
+    .check_nullable();
+  Value(options, "max")
+    .get(max)
+    .check_nullable();
+  Value(options, "relativeError")
+    .get(relative_error)
+    .check_nullable();
+  if (min <= 0) throw std::runtime_error("options.min must be greater than zero");
+  if (max <= min) throw std::runtime_error("options.max must be greater than options.min");
+  if (relative_error <= 0 || relative_error >= 1) throw std::runtime_error("options.relativeError must be between 0 and 1");
+  auto gamma = (1 + relative_error) / (1 - relative_error);
+  auto n = std::ceil(std::log(max / min) / std::log(gamma)) + 2;
+  if (n > MAX_BUCKETS) {
+    throw std::runtime_error(
+      "options.relativeError is too small for the range from options.min to options.max, needing " +
+      std::to_string(int64_t(std::min(n, 1e18))) + " buckets out of the maximum " + std::to_string(MAX_BUCKETS)
+    );
+  }
+}
+
+//
+// Buckets growing by a factor of (1+e)/(1-e) so that any sample
+// is within the relative error from the middle of its bucket,
+// as in DDSketch. Since they are fixed for the given range,
+// sketches merge by adding up their counts bucket by bucket.
+//
+
+auto Percentile::buckets(const Options &options) -> pjs::Array* {
+  auto gamma = (1 + options.relative_error) / (1 - options.relative_error);
+  auto n = int(std::ceil(std::log(options.max / options.min) / std::log(gamma)));
+  auto a = pjs::Array::make(n + 2);
+  for (int i = 0; i <= n; i++) a->set(i, options.min * std::pow(gamma, i));
+  a->set(n + 1, std::numeric_limits<double>::infinity());
+  return a;
+}
+
 Percentile::Percentile(pjs::Array *buckets)
   : m_counts(buckets->length())
   , m_buckets(buckets->length())
@@ -1378,12 +1757,34 @@ Percentile::Percentile(pjs::Array *buckets)
           "buckets are not in ascending order: changed from %f to %f at #%d",
           last, limit, i
         );
+        m_sorted = false;
       }
       m_buckets[i] = limit;
       last = limit;
     }
   );
 
+  // Log-spaced buckets are located by the exponent
+  // instead of a search, leaving out any infinite tail
+  auto n = m_buckets.size();
+  while (n > 0 && std::isinf(m_buckets[n-1])) n--;
+  if (m_sorted && n >= 3 && m_buckets[0] > 0) {
+    auto scale = std::log(m_buckets[1] / m_buckets[0]);
+    auto geometric = true;
+    for (size_t i = 2; i < n; i++) {
+      auto r = std::log(m_buckets[i] / m_buckets[i-1]);
+      if (std::abs(r - scale) > scale * 1e-6) {
+        geometric = false;
+        break;
+      }
+    }
+    if (geometric) {
+      m_log_size = n;
+      m_log_base = m_buckets[0];
+      m_log_scale = 1 / scale;
+    }
+  }
+
   reset();
 }
 
@@ -1410,13 +1811,39 @@ void Percentile::set(int bucket, size_t count) {
 }
 
 void Percentile::observe(double sample) {
-  for (size_t i = 0, n = m_counts.size(); i < n; i++) {
-    if (sample <= m_buckets[i]) {
-      m_counts[i]++;
-      m_sample_count++;
-      break;
+  auto i = locate(sample);
+  if (i < m_counts.size()) {
+    m_counts[i]++;
+    m_sample_count++;
+  }
+}
+
+auto Percentile::locate(double sample) const -> size_t {
+  auto n = m_buckets.size();
+  if (std::isnan(sample)) return n;
+
+  if (auto k = m_log_size) {
+    if (sample <= m_log_base) return 0;
+    auto f = std::ceil(std::log(sample / m_log_base) * m_log_scale);
+    if (f < k) {
+      // Rounding can take the index off by one either way
+      size_t i = f;
+      if (i > 0 && sample <= m_buckets[i-1]) i--;
+      else if (sample > m_buckets[i]) i++;
+      if (i < k) return i;
     }
+    return std::lower_bound(m_buckets.begin() + k, m_buckets.end(), sample) - m_buckets.begin();
   }
+
+  if (m_sorted) {
+    return std::lower_bound(m_buckets.begin(), m_buckets.end(), sample) - m_buckets.begin();
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (sample <= m_buckets[i]) return i;
+  }
+
+  return n;
 }
 
 auto Percentile::calculate(int percentage) -> double {
@@ -1597,9 +2024,17 @@ template<> void ClassDef<Constructor<URLRouter>>::init() {
 // LoadBalancer
 //
 
+template<> void EnumDef<HashingLoadBalancer::Algorithm>::init() {
+  define(HashingLoadBalancer::MODULO, "modulo");
+  define(HashingLoadBalancer::RING, "ring");
+  define(HashingLoadBalancer::MAGLEV, "maglev");
+}
+
 template<> void EnumDef<LoadBalancer::Algorithm>::init() {
   define(LoadBalancer::ROUND_ROBIN, "round-robin");
   define(LoadBalancer::LEAST_LOAD, "least-load");
+  define(LoadBalancer::POWER_OF_TWO, "power-of-two");
+  define(LoadBalancer::PEAK_EWMA, "peak-ewma");
 }
 
 template<> void ClassDef<LoadBalancer::Resource>::init() {
@@ -1705,8 +2140,14 @@ template<> void ClassDef<HashingLoadBalancer>::init() {
   ctor([](Context &ctx) -> Object* {
     Object *targets = nullptr;
     Cache *unhealthy = nullptr;
-    if (!ctx.arguments(0, &targets, &unhealthy)) return nullptr;
-    return HashingLoadBalancer::make(targets, unhealthy);
+    Object *options = nullptr;
+    if (!ctx.arguments(0, &targets, &unhealthy, &options)) return nullptr;
+    try {
+      return HashingLoadBalancer::make(targets, unhealthy, options);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
   });
 
   method("set", [](Context &ctx, Object *obj, Value &ret) {
@@ -1717,8 +2158,9 @@ template<> void ClassDef<HashingLoadBalancer>::init() {
 
   method("add", [](Context &ctx, Object *obj, Value &ret) {
     Str *target;
-    if (!ctx.arguments(1, &target)) return;
-    obj->as<HashingLoadBalancer>()->add(target);
+    double weight = 1;
+    if (!ctx.arguments(1, &target, &weight)) return;
+    obj->as<HashingLoadBalancer>()->add(target, weight);
   });
 }
 
@@ -1830,10 +2272,13 @@ template<> void ClassDef<Constructor<ResourcePool>>::init() {
 
 template<> void ClassDef<Percentile>::init() {
   ctor([](Context &ctx) -> Object* {
-    Array *buckets;
-    if (!ctx.check(0, buckets)) return nullptr;
+    Array *buckets = nullptr;
+    Object *options = nullptr;
+    if (!ctx.get(0, buckets) && !ctx.check(0, options)) return nullptr;
     try {
-      return Percentile::make(buckets);
+      if (buckets) return Percentile::make(buckets);
+      pjs::Ref<Array> a = Percentile::buckets(Percentile::Options(options));
+      return Percentile::make(a);
     } catch (std::runtime_error &err) {
       ctx.error(err);
       return nullptr;
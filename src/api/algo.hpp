@@ -33,6 +33,7 @@
 #include "options.hpp"
 
 #include <atomic>
+#include <deque>
 #include <limits>
 #include <map>
 #include <mutex>
@@ -310,8 +311,14 @@ private:
     double weight = 1;
     double step = 0;
     double load = 0;
+    int active = 0;
+    double latency = 0;
+    double latency_time = 0;
+    double latency_decay = 0;
 
     auto allocate() -> Resource*;
+    auto peak_latency(double now) const -> double;
+    void update_latency(double now, double sample);
 
   private:
     List<Resource> m_resources;
@@ -328,6 +335,8 @@ public:
   enum Algorithm {
     ROUND_ROBIN,
     LEAST_LOAD,
+    POWER_OF_TWO,
+    PEAK_EWMA,
   };
 
   //
@@ -340,6 +349,7 @@ public:
     pjs::Ref<pjs::Function> weight_f;
     pjs::Ref<pjs::Function> capacity_f;
     int capacity = 0;
+    double latency_decay = 10;
     Options() {}
     Options(pjs::Object *options);
   };
@@ -365,6 +375,7 @@ public:
     pjs::Ref<Pool> m_pool;
     pjs::Value m_target;
     int m_load = 0;
+    std::deque<double> m_start_times;
 
     void increase_load();
 
@@ -383,9 +394,15 @@ private:
   Options m_options;
   std::map<pjs::Value, Pool*> m_targets;
   std::vector<pjs::Ref<Pool>> m_pools;
+  std::vector<double> m_alias_probs;
+  std::vector<int> m_aliases;
   List<Pool> m_queue;
 
   auto next(const std::function<bool(const pjs::Value &)> &validator) -> Pool*;
+  auto pick(const std::function<bool(const pjs::Value &)> &validator) -> Pool*;
+  auto sample() -> int;
+  auto cost(Pool *pool, double now) const -> double;
+  void build_aliases();
   void increase_load(Pool *pool);
   void decrease_load(Pool *pool);
   void sort_forward(List<Pool> &queue, Pool *pool);
@@ -479,17 +496,69 @@ private:
 
 class HashingLoadBalancer : public pjs::ObjectTemplate<HashingLoadBalancer, LoadBalancerBase> {
 public:
+
+  //
+  // HashingLoadBalancer::Algorithm
+  //
+
+  enum Algorithm {
+    MODULO,
+    RING,
+    MAGLEV,
+  };
+
+  //
+  // HashingLoadBalancer::Options
+  //
+
+  struct Options : public pipy::Options {
+    Algorithm algorithm = MODULO;
+    int virtual_nodes = 160;
+    int table_size = 65537;
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
   void set(pjs::Object *targets);
-  void add(pjs::Str *target);
+  void add(pjs::Str *target, double weight = 1);
 
   virtual auto select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* override;
   virtual void deselect(pjs::Str *target) override {}
 
 private:
-  HashingLoadBalancer(pjs::Object *targets, Cache *unhealthy = nullptr);
+  HashingLoadBalancer(pjs::Object *targets, Cache *unhealthy = nullptr, const Options &options = Options());
   ~HashingLoadBalancer();
 
+  //
+  // HashingLoadBalancer::Target
+  //
+  // Ring points and the Maglev permutation only depend on the
+  // target's name and weight, so they are kept across updates
+  //
+
+  struct Target {
+    pjs::Ref<pjs::Str> id;
+    double weight = 1;
+    std::vector<uint64_t> points;
+    uint64_t offset = 0;
+    uint64_t skip = 1;
+  };
+
+  static const int MAX_POINTS = 0x10000;
+  static constexpr double MAX_WEIGHT = 1e6;
+
+  Options m_options;
   std::vector<pjs::Ref<pjs::Str>> m_targets;
+  std::map<pjs::Str*, Target> m_target_map;
+  std::vector<std::pair<uint64_t, pjs::Str*>> m_ring;
+  std::vector<pjs::Str*> m_maglev;
+
+  template<class At>
+  auto walk(size_t i, size_t n, Cache *unhealthy, const At &at) -> pjs::Str*;
+
+  void update(const std::vector<std::pair<pjs::Ref<pjs::Str>, double>> &targets);
+  void init_target(Target &target);
+  void build_maglev();
 
   friend class pjs::ObjectTemplate<HashingLoadBalancer, LoadBalancerBase>;
 };
@@ -561,6 +630,25 @@ private:
 
 class Percentile : public pjs::ObjectTemplate<Percentile> {
 public:
+
+  //
+  // Percentile::Options
+  //
+  // Log-spaced buckets with a bounded relative error
+  //
+
+  static const int MAX_BUCKETS = 998;
+
+  struct Options : public pipy::Options {
+    double min = 0.001;
+    double max = 60;
+    double relative_error = 0.05;
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  static auto buckets(const Options &options) -> pjs::Array*;
+
   void reset();
   auto size() const -> size_t { return m_buckets.size(); }
   auto get(int bucket) -> size_t;
@@ -575,6 +663,12 @@ private:
   std::vector<size_t> m_counts;
   std::vector<double> m_buckets;
   size_t m_sample_count;
+  size_t m_log_size = 0;
+  double m_log_base = 0;
+  double m_log_scale = 0;
+  bool m_sorted = true;
+
+  auto locate(double sample) const -> size_t;
 
   friend class pjs::ObjectTemplate<Percentile>;
 };
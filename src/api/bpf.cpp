@@ -34,6 +34,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <elf.h>
+#include <sys/socket.h>
 #include <sys/syscall.h>
 
 #include "api/linux/bpf.h"
@@ -935,6 +936,136 @@ auto BPF::cgroup(const std::string &pathname) -> uint64_t {
   return *(uint64_t *)fh->f_handle;
 }
 
+//
+// ReusePortSelector
+//
+// Steers new connections on a SO_REUSEPORT group by looking up the
+// 4-tuple hash in a table of socket indices, which is the only value
+// of a single-entry array map so that it can be replaced in one go:
+//
+//   table = target_map[0]
+//   if (table) bpf_sk_select_reuseport(ctx, socket_map, &table[hash % TABLE_SIZE], 0)
+//   return SK_PASS
+//
+// When the selected slot is empty the kernel falls back to hashing.
+//
+
+static int bpf_map_create(const char *name, int type, int key_size, int value_size, int max_entries) {
+  union bpf_attr attr;
+  int fd = syscall_bpf(
+    BPF_MAP_CREATE, &attr, attr_size(map_flags),
+    [&](union bpf_attr &attr) {
+      std::strncpy(attr.map_name, name, sizeof(attr.map_name) - 1);
+      attr.map_type = type;
+      attr.key_size = key_size;
+      attr.value_size = value_size;
+      attr.max_entries = max_entries;
+    }
+  );
+  if (fd < 0) syscall_error("BPF_MAP_CREATE");
+  return fd;
+}
+
+static void bpf_map_update(int fd, const void *key, const void *value) {
+  union bpf_attr attr;
+  if (syscall_bpf(
+    BPF_MAP_UPDATE_ELEM, &attr, attr_size(flags),
+    [&](union bpf_attr &attr) {
+      attr.map_fd = fd;
+      attr.key = (uintptr_t)key;
+      attr.value = (uintptr_t)value;
+    }
+  )) syscall_error("BPF_MAP_UPDATE_ELEM");
+}
+
+ReusePortSelector::ReusePortSelector(int max_sockets) {
+  try {
+    m_sockets_fd = bpf_map_create("pipy_rp_socks", BPF_MAP_TYPE_REUSEPORT_SOCKARRAY, 4, 8, max_sockets);
+    m_target_fd = bpf_map_create("pipy_rp_table", BPF_MAP_TYPE_ARRAY, 4, TABLE_SIZE * 4, 1);
+
+    struct bpf_insn insts[] = {
+      { BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0 },            // r6 = ctx
+      { BPF_LDX | BPF_MEM | BPF_W, 7, 1, offsetof(struct sk_reuseport_md, hash), 0 },
+      { BPF_ALU64 | BPF_AND | BPF_K, 7, 0, 0, TABLE_SIZE - 1 },
+      { BPF_ALU64 | BPF_LSH | BPF_K, 7, 0, 0, 2 },            // r7 = (hash % TABLE_SIZE) * 4
+      { BPF_ST | BPF_MEM | BPF_W, 10, 0, -4, 0 },             // *(u32*)(fp-4) = 0
+      { BPF_ALU64 | BPF_MOV | BPF_X, 2, 10, 0, 0 },           // r2 = fp
+      { BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, -4 },           // r2 -= 4
+      { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, m_target_fd },
+      { 0, 0, 0, 0, 0 },                                      // r1 = target_map
+      { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem },
+      { BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 10, 0 },             // if !r0 goto pass
+      { BPF_ALU64 | BPF_ADD | BPF_X, 0, 7, 0, 0 },            // r0 += r7
+      { BPF_LDX | BPF_MEM | BPF_W, 0, 0, 0, 0 },              // r0 = *(u32*)r0
+      { BPF_STX | BPF_MEM | BPF_W, 10, 0, -8, 0 },            // *(u32*)(fp-8) = r0
+      { BPF_ALU64 | BPF_MOV | BPF_X, 1, 6, 0, 0 },            // r1 = ctx
+      { BPF_LD | BPF_DW | BPF_IMM, 2, BPF_PSEUDO_MAP_FD, 0, m_sockets_fd },
+      { 0, 0, 0, 0, 0 },                                      // r2 = socket_map
+      { BPF_ALU64 | BPF_MOV | BPF_X, 3, 10, 0, 0 },           // r3 = fp
+      { BPF_ALU64 | BPF_ADD | BPF_K, 3, 0, 0, -8 },           // r3 -= 8
+      { BPF_ALU64 | BPF_MOV | BPF_K, 4, 0, 0, 0 },            // r4 = 0
+      { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_select_reuseport },
+      { BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, SK_PASS },      // pass: r0 = SK_PASS
+      { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+    };
+
+    static const char license[] = "GPL";
+    std::vector<char> log_buf(64*1024);
+    union bpf_attr attr;
+    m_prog_fd = syscall_bpf(
+      BPF_PROG_LOAD, &attr, attr_size(expected_attach_type),
+      [&](union bpf_attr &attr) {
+        std::strncpy(attr.prog_name, "pipy_rp_select", sizeof(attr.prog_name) - 1);
+        attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+        attr.insn_cnt = sizeof(insts) / sizeof(insts[0]);
+        attr.insns = (uintptr_t)insts;
+        attr.license = (uintptr_t)license;
+        attr.log_level = 1;
+        attr.log_size = log_buf.size();
+        attr.log_buf = (uintptr_t)log_buf.data();
+      }
+    );
+    if (log_buf[0] && Log::is_enabled(Log::BPF)) {
+      Log::debug(Log::BPF, "[bpf] In-kernel verifier log:");
+      Log::write(log_buf.data());
+    }
+    if (m_prog_fd < 0) syscall_error("BPF_PROG_LOAD");
+
+    uint32_t table[TABLE_SIZE];
+    for (int i = 0; i < TABLE_SIZE; i++) table[i] = i % max_sockets;
+    select(table);
+
+  } catch (std::runtime_error &) {
+    if (m_prog_fd >= 0) ::close(m_prog_fd);
+    if (m_sockets_fd >= 0) ::close(m_sockets_fd);
+    if (m_target_fd >= 0) ::close(m_target_fd);
+    throw;
+  }
+}
+
+ReusePortSelector::~ReusePortSelector() {
+  ::close(m_prog_fd);
+  ::close(m_target_fd);
+  ::close(m_sockets_fd);
+}
+
+void ReusePortSelector::attach(int sock) {
+  if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, &m_prog_fd, sizeof(m_prog_fd))) {
+    syscall_error("setsockopt(SO_ATTACH_REUSEPORT_EBPF)");
+  }
+}
+
+void ReusePortSelector::add(int index, int sock) {
+  uint32_t key = index;
+  uint64_t value = sock;
+  bpf_map_update(m_sockets_fd, &key, &value);
+}
+
+void ReusePortSelector::select(const uint32_t table[TABLE_SIZE]) {
+  uint32_t key = 0;
+  bpf_map_update(m_target_fd, &key, table);
+}
+
 #else // !PIPY_USE_BPF
 
 static void unsupported() {
@@ -1045,6 +1176,25 @@ auto BPF::cgroup(const std::string &pathname) -> uint64_t {
   return 0;
 }
 
+ReusePortSelector::ReusePortSelector(int max_sockets) {
+  unsupported();
+}
+
+ReusePortSelector::~ReusePortSelector() {
+}
+
+void ReusePortSelector::attach(int sock) {
+  unsupported();
+}
+
+void ReusePortSelector::add(int index, int sock) {
+  unsupported();
+}
+
+void ReusePortSelector::select(const uint32_t table[TABLE_SIZE]) {
+  unsupported();
+}
+
 #endif // PIPY_USE_BPF
 
 } // namespace bpf
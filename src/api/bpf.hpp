@@ -179,6 +179,27 @@ public:
   static auto cgroup(const std::string &pathname) -> uint64_t;
 };
 
+//
+// ReusePortSelector
+//
+
+class ReusePortSelector {
+public:
+  static const int TABLE_SIZE = 64;
+
+  ReusePortSelector(int max_sockets);
+  ~ReusePortSelector();
+
+  void attach(int sock);
+  void add(int index, int sock);
+  void select(const uint32_t table[TABLE_SIZE]);
+
+private:
+  int m_sockets_fd = -1;
+  int m_target_fd = -1;
+  int m_prog_fd = -1;
+};
+
 } // namespace bpf
 } // namespace pipy
 
@@ -784,6 +784,11 @@ void Configuration::apply(JSModule *mod) {
     } else {
       std::snprintf(name, sizeof(name), "ListenerArray#%d", i.index);
     }
+    if (i.filters.size() == 1) {
+      if (auto c = dynamic_cast<Connect*>(i.filters.front().get())) {
+        c->splice(true);
+      }
+    }
     auto p = make_pipeline(i.index, "", name, i);
     i.listeners->apply(worker, p);
     i.listeners = nullptr;
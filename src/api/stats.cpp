@@ -29,6 +29,7 @@
 #include "utils.hpp"
 #include "log.hpp"
 
+#include <atomic>
 #include <cmath>
 
 //
@@ -77,6 +78,15 @@ thread_local static pjs::ConstStr s_str_count("count");
 thread_local static pjs::ConstStr s_str_sum("sum");
 static Data::Producer s_dp("Stats");
 
+// Changed whenever a metric on the current thread is added,
+// removed or gets new submetrics, so that a MetricData can
+// tell when its nodes no longer match the metrics
+thread_local static uint64_t s_metric_layout = 0;
+
+// Identifies each shape a MetricData has ever had, so that
+// a MetricDataSum can tell when to map its nodes again
+static std::atomic<uint64_t> s_metric_data_layout(0);
+
 //
 // Metric
 //
@@ -126,6 +136,7 @@ Metric::Metric(Metric *parent, pjs::Str **labels)
   parent->m_subs.emplace_back();
   parent->m_subs.back() = this;
   parent->m_sub_map[m_label] = this;
+  s_metric_layout++;
 }
 
 auto Metric::submetrics() -> pjs::Array* {
@@ -172,6 +183,7 @@ void Metric::clear() {
   m_subs.clear();
   m_sub_map.clear();
   m_has_value = false;
+  s_metric_layout++;
 }
 
 void Metric::create_value() {
@@ -205,6 +217,7 @@ auto Metric::get_sub(int i) -> Metric* {
 //
 
 void MetricSet::add(Metric *metric) {
+  s_metric_layout++;
   auto i = m_metric_map.find(metric->name());
   if (i == m_metric_map.end()) {
     m_metric_map[metric->name()] = m_metrics.size();
@@ -230,6 +243,7 @@ auto MetricSet::get(int i) -> Metric* {
 }
 
 void MetricSet::clear() {
+  s_metric_layout++;
   m_metric_map.clear();
   m_metrics.clear();
 }
@@ -369,6 +383,23 @@ MetricData::~MetricData() {
 }
 
 void MetricData::update(MetricSet &metrics) {
+
+  // Metrics are laid out as they were last time,
+  // so only copy over their values
+  if (&metrics == m_metric_set && s_metric_layout == m_metric_layout) {
+    for (const auto &s : m_slots) {
+      auto node = s.node;
+      auto metric = s.metric;
+      node->has_value = metric->has_value();
+      for (int d = 0; d < s.dimensions; d++) {
+        node->values[d] = metric->get_value(d);
+      }
+    }
+    return;
+  }
+
+  m_slots.clear();
+
   std::function<void(int, Node*, Metric*)> update;
 
   update = [&](int level, Node *node, Metric *metric) {
@@ -379,6 +410,7 @@ void MetricData::update(MetricSet &metrics) {
     for (int d = 0; d < dim; d++) {
       node->values[d] = metric->get_value(d);
     }
+    m_slots.push_back({ metric, node, dim });
 
     auto **sub = &node->subs;
     for (const auto &m : metric->m_subs) {
@@ -422,9 +454,16 @@ void MetricData::update(MetricSet &metrics) {
     auto ent = e; e = e->next;
     delete ent;
   }
+
+  m_metric_set = &metrics;
+  m_metric_layout = s_metric_layout;
+  m_layout = ++s_metric_data_layout;
 }
 
 bool MetricData::deserialize(const Data &in) {
+  m_metric_set = nullptr;
+  m_slots.clear();
+  m_layout = ++s_metric_data_layout;
   Deserializer des(this);
   if (!JSON::visit(in, &des)) {
     Log::error("[stats] JSON deserialization failed for metrics");
@@ -651,7 +690,7 @@ void MetricData::Deserializer::string(const char *s, size_t len) {
                 for (auto c : str->str()) if (c == ',') dim++;
                 dim += 2;
               }
-              if (dim <= 100) {
+              if (dim <= algo::Percentile::MAX_BUCKETS + 2) {
                 auto node = Node::make(dim);
                 m_current_entry->type = str->data();
                 m_current_entry->dimensions = dim;
@@ -798,6 +837,32 @@ MetricDataSum::~MetricDataSum() {
 }
 
 void MetricDataSum::sum(MetricData &data, bool initial) {
+
+  // Same shape as last time, so add up values
+  // straight into the nodes they went to before
+  auto l = m_layouts.find(&data);
+  if (l != m_layouts.end() && l->second.id == data.m_layout) {
+    const auto &layout = l->second;
+    if (initial) {
+      for (const auto &p : layout.entries) {
+        p.first->root->zero(p.second);
+      }
+    }
+    for (const auto &s : layout.slots) {
+      auto node = s.node;
+      auto src_node = s.src_node;
+      node->has_value |= src_node->has_value;
+      for (int i = 0; i < s.dimensions; i++) {
+        node->values[i] += src_node->values[i];
+      }
+    }
+    return;
+  }
+
+  Layout layout;
+  layout.id = data.m_layout;
+  bool reset = false;
+
   std::function<void(int, Node*, MetricData::Node*)> sum;
 
   sum = [&](int dimensions, Node *node, MetricData::Node* src_node) {
@@ -805,6 +870,7 @@ void MetricDataSum::sum(MetricData &data, bool initial) {
     for (int i = 0; i < dimensions; i++) {
       node->values[i] += src_node->values[i];
     }
+    layout.slots.push_back({ node, src_node, dimensions });
 
     auto &submap = node->submap;
     for (auto s = src_node->subs; s; s = s->next) {
@@ -844,6 +910,7 @@ void MetricDataSum::sum(MetricData &data, bool initial) {
       ent->dimensions = e->dimensions;
       ent->labels.clear();
       ent->root.reset(Node::make(ent->dimensions));
+      reset = true;
     }
 
     name->release();
@@ -854,11 +921,17 @@ void MetricDataSum::sum(MetricData &data, bool initial) {
       ent->root->zero(e->dimensions);
     }
 
+    layout.entries.push_back({ ent, e->dimensions });
+
     sum(
       std::min(ent->dimensions, e->dimensions),
       ent->root.get(), e->root.get()
     );
   }
+
+  // Replaced nodes could be in the layouts of other data
+  if (reset) m_layouts.clear();
+  m_layouts[&data] = std::move(layout);
 }
 
 void MetricDataSum::serialize(Data::Builder &db, bool initial) {
@@ -1510,7 +1583,7 @@ auto Histogram::get_value(int dim) -> double {
 void Histogram::set_value(int dim, double value) {
   int size = m_percentile->size();
   if (0 <= dim && dim < size) {
-    m_percentile->set(dim - 1, value);
+    m_percentile->set(dim, value);
   }
   switch (dim - size) {
     case 0: m_count = value; break;
@@ -1675,13 +1748,16 @@ template<> void ClassDef<Histogram>::init() {
 
   ctor([](Context &ctx) -> Object* {
     Str *name;
-    Array *buckets;
+    Array *buckets = nullptr;
+    Object *options = nullptr;
     Array *labels = nullptr;
     if (!ctx.check(0, name)) return nullptr;
-    if (!ctx.check(1, buckets)) return nullptr;
+    if (!ctx.get(1, buckets) && !ctx.check(1, options)) return nullptr;
     if (!ctx.check(2, labels, labels)) return nullptr;
     try {
-      return Histogram::make(name, buckets, labels);
+      if (buckets) return Histogram::make(name, buckets, labels);
+      pjs::Ref<Array> a = algo::Percentile::buckets(algo::Percentile::Options(options));
+      return Histogram::make(name, a.get(), labels);
     } catch (std::runtime_error &err) {
       ctx.error(err);
       return nullptr;
@@ -270,8 +270,22 @@ private:
     virtual void array_end() override;
   };
 
+  //
+  // MetricData::Slot
+  //
+
+  struct Slot {
+    Metric* metric;
+    Node* node;
+    int dimensions;
+  };
+
   Entry* m_entries = nullptr;
   uint64_t m_version = 0;
+  MetricSet* m_metric_set = nullptr;
+  uint64_t m_metric_layout = 0;
+  uint64_t m_layout = 0;
+  std::vector<Slot> m_slots;
 
   friend class MetricDataSum;
   friend class MetricHistory;
@@ -329,8 +343,25 @@ private:
     std::unique_ptr<Node> root;
   };
 
+  //
+  // MetricDataSum::Layout
+  //
+
+  struct Layout {
+    struct Slot {
+      Node* node;
+      MetricData::Node* src_node;
+      int dimensions;
+    };
+
+    uint64_t id = 0;
+    std::vector<std::pair<Entry*, int>> entries;
+    std::vector<Slot> slots;
+  };
+
   List<Entry> m_entries;
   std::unordered_map<pjs::Str*, Entry*> m_entry_map;
+  std::unordered_map<const MetricData*, Layout> m_layouts;
   uint64_t m_version = 0;
 
   static void create_metrics(Entry *ent, Node *node, Metric *metric);
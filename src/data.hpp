@@ -353,6 +353,36 @@ public:
     int m_position = 0;
   };
 
+  //
+  // Data::Block
+  //
+
+  class Block {
+  public:
+    Block(Producer *producer = nullptr)
+      : m_chunk(new Chunk(producer ? producer : &s_unknown_producer))
+    {
+      m_chunk->retain();
+    }
+
+    ~Block() {
+      m_chunk->release();
+    }
+
+    auto ptr() const -> char* { return m_chunk->data; }
+    auto size() const -> int { return m_chunk->size(); }
+
+    void to_data(Data &data, int offset, int length) const {
+      data.push_view(new View(m_chunk, offset, length));
+    }
+
+  private:
+    Block(const Block &) = delete;
+    Block& operator=(const Block &) = delete;
+
+    Chunk* m_chunk;
+  };
+
 private:
 
   //
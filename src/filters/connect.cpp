@@ -24,6 +24,8 @@
  */
 
 #include "connect.hpp"
+#include "context.hpp"
+#include "inbound.hpp"
 #include "outbound.hpp"
 #include "utils.hpp"
 
@@ -100,6 +102,7 @@ Connect::Connect(const Connect &r)
   , m_target(r.m_target)
   , m_options_f(r.m_options_f)
   , m_options(r.m_options)
+  , m_splice(r.m_splice)
 {
 }
 
@@ -221,6 +224,12 @@ void Connect::process(Event *evt) {
         m_outbound->connect(target.s()->str());
       }
 
+      if (m_splice && protocol == Outbound::Protocol::TCP) {
+        if (auto inbound = dynamic_cast<InboundTCP*>(Filter::context()->inbound())) {
+          static_cast<OutboundTCP*>(m_outbound.get())->splice(inbound);
+        }
+      }
+
     } catch (std::runtime_error &e) {
       m_outbound = nullptr;
       Filter::error("%s", e.what());
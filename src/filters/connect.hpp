@@ -50,6 +50,9 @@ public:
   Connect(const pjs::Value &target, const Options &options);
   Connect(const pjs::Value &target, pjs::Function *options);
 
+  // Relay bytes in the kernel when this is all the pipeline does
+  void splice(bool b) { m_splice = b; }
+
 private:
   Connect(const Connect &r);
   ~Connect();
@@ -64,6 +67,7 @@ private:
   pjs::Ref<pjs::Function> m_options_f;
   Options m_options;
   bool m_end_input = false;
+  bool m_splice = false;
 
   friend class ConnectReceiver;
 };
@@ -156,10 +156,10 @@ private:
     };
 
     std::atomic<bool> m_exited;
-    std::thread m_thread;
     std::mutex m_mutex;
     std::condition_variable m_workload_cv;
     std::map<int, Monitor> m_monitors;
+    std::thread m_thread; // started last, once everything it uses is constructed
   };
 
   static ChildProcessMonitor s_child_process_monitor;
@@ -85,6 +85,15 @@ thread_local static const pjs::ConstStr s_trailers("trailers");
 thread_local static const pjs::ConstStr s_content_length("content-length");
 thread_local static const pjs::ConstStr s_cookie("cookie");
 thread_local static const pjs::ConstStr s_set_cookie("set-cookie");
+thread_local static const pjs::ConstStr s_authorization("authorization");
+thread_local static const pjs::ConstStr s_proxy_authorization("proxy-authorization");
+thread_local static const pjs::ConstStr s_age("age");
+thread_local static const pjs::ConstStr s_date("date");
+thread_local static const pjs::ConstStr s_etag("etag");
+thread_local static const pjs::ConstStr s_if_modified_since("if-modified-since");
+thread_local static const pjs::ConstStr s_if_none_match("if-none-match");
+thread_local static const pjs::ConstStr s_last_modified("last-modified");
+thread_local static const pjs::ConstStr s_location("location");
 
 static struct {
   const char *name;
@@ -719,7 +728,7 @@ void DynamicTable::evict() {
 
 thread_local
 const HeaderDecoder::StaticTable HeaderDecoder::s_static_table;
-const HeaderDecoder::HuffmanTree HeaderDecoder::s_huffman_tree;
+const HeaderDecoder::HuffmanTable HeaderDecoder::s_huffman_table;
 
 HeaderDecoder::HeaderDecoder(const Settings &settings)
   : m_settings(settings)
@@ -853,35 +862,33 @@ bool HeaderDecoder::read_int(uint8_t c) {
 
 bool HeaderDecoder::read_str(uint8_t c, bool lowercase_only) {
   if (m_prefix & 0x80) {
-    const auto &tree = s_huffman_tree.get();
-    int last_bit = 8;
-    for (int b = 7; b >= 0; b--) {
-      bool bit = (c >> b) & 1;
-      m_ptr = bit ? tree[m_ptr].right : tree[m_ptr].left;
-      auto &node = tree[m_ptr];
-      if (!node.left) {
-        auto ch = node.right;
-        if (ch == 256) {
-          error(); // EOS is considered an error
+    const auto &t1 = s_huffman_table.get(m_ptr, c >> 4);
+    const auto &t2 = s_huffman_table.get(t1.state, c & 0x0f);
+    auto flags = t1.flags | t2.flags;
+    if (flags & HuffmanTable::FAIL) {
+      error(); // EOS is considered an error
+      return false;
+    }
+    if (flags & HuffmanTable::EMIT) {
+      if (t1.flags & HuffmanTable::EMIT) {
+        if (lowercase_only && std::tolower(t1.symbol) != t1.symbol) {
+          error(PROTOCOL_ERROR);
           return false;
         }
-        if (lowercase_only) {
-          if (std::tolower(ch) != ch) {
-            error(PROTOCOL_ERROR);
-            return false;
-          }
+        s_dp.push(&m_buffer, char(t1.symbol));
+      }
+      if (t2.flags & HuffmanTable::EMIT) {
+        if (lowercase_only && std::tolower(t2.symbol) != t2.symbol) {
+          error(PROTOCOL_ERROR);
+          return false;
         }
-        s_dp.push(&m_buffer, char(ch));
-        m_ptr = 0;
-        last_bit = b;
+        s_dp.push(&m_buffer, char(t2.symbol));
       }
     }
-    if (m_int == 1) {
-      uint8_t mask = uint8_t(1 << last_bit) - 1;
-      if (mask == 0xff || (c & mask) != mask) {
-        error();
-        return false;
-      }
+    m_ptr = t2.state;
+    if (m_int == 1 && !(t2.flags & HuffmanTable::ACCEPT)) {
+      error(); // padding longer than 7 bits or not all ones
+      return false;
     }
   } else {
     if (lowercase_only) {
@@ -1096,26 +1103,75 @@ HeaderDecoder::StaticTable::StaticTable() {
 }
 
 //
-// HeaderDecoder::HuffmanTree
+// HeaderDecoder::HuffmanTable
 //
 
-HeaderDecoder::HuffmanTree::HuffmanTree() {
+HeaderDecoder::HuffmanTable::HuffmanTable() {
+  struct Node {
+    int child[2] = { -1, -1 };
+    int symbol = -1;
+    int depth = 0;
+    bool all_ones = true;
+    int state = -1;
+  };
+
+  // Build the tree first
+  std::vector<Node> tree(1);
   int n = sizeof(s_hpack_huffman_table) / sizeof(s_hpack_huffman_table[0]);
-  m_tree.resize(1);
   for (int i = 0; i < n; i++) {
     auto &p = s_hpack_huffman_table[i];
     int ptr = 0;
     for (int b = p.bits - 1; b >= 0; b--) {
-      bool bit = (p.code >> b) & 1;
-      auto &node = m_tree[ptr];
-      ptr = bit ? node.right : node.left;
-      if (!ptr) {
-        ptr = m_tree.size();
-        (bit ? node.right : node.left) = ptr;
-        m_tree.emplace_back();
+      int bit = (p.code >> b) & 1;
+      auto next = tree[ptr].child[bit];
+      if (next < 0) {
+        next = tree.size();
+        tree[ptr].child[bit] = next;
+        tree.emplace_back();
+        tree[next].depth = tree[ptr].depth + 1;
+        tree[next].all_ones = tree[ptr].all_ones && bit;
       }
+      ptr = next;
+    }
+    tree[ptr].symbol = i;
+  }
+
+  // Number the internal nodes as states, with the root being state 0
+  int state_count = 0;
+  std::vector<int> states;
+  for (int i = 0; i < int(tree.size()); i++) {
+    if (tree[i].symbol < 0) {
+      tree[i].state = state_count++;
+      states.push_back(i);
+    }
+  }
+
+  // Walk 4 bits from every state
+  m_table.resize(state_count << 4);
+  for (int s = 0; s < state_count; s++) {
+    for (int nibble = 0; nibble < 16; nibble++) {
+      auto &t = m_table[(s << 4) | nibble];
+      int ptr = states[s];
+      t.flags = 0;
+      t.symbol = 0;
+      for (int b = 3; b >= 0; b--) {
+        ptr = tree[ptr].child[(nibble >> b) & 1];
+        auto sym = tree[ptr].symbol;
+        if (sym >= 0) {
+          if (sym == 256) {
+            t.flags |= FAIL;
+            ptr = 0;
+            break;
+          }
+          t.flags |= EMIT;
+          t.symbol = sym;
+          ptr = 0;
+        }
+      }
+      auto &node = tree[ptr];
+      if (node.all_ones && node.depth < 8) t.flags |= ACCEPT;
+      t.state = node.state;
     }
-    m_tree[ptr].right = i;
   }
 }
 
@@ -1125,18 +1181,48 @@ HeaderDecoder::HuffmanTree::HuffmanTree() {
 
 thread_local HeaderEncoder::StaticTable HeaderEncoder::m_static_table;
 
+HeaderEncoder::HeaderEncoder(const Settings &peer_settings)
+  : m_peer_settings(peer_settings)
+{
+  m_never_index.insert(s_authorization.get());
+  m_never_index.insert(s_proxy_authorization.get());
+}
+
+void HeaderEncoder::reset() {
+  m_index_table.reset();
+  m_index_table.resize(Settings::DEFAULT_HEADER_TABLE_SIZE);
+  m_peer_table_size = Settings::DEFAULT_HEADER_TABLE_SIZE;
+  m_table_size_changed = false;
+}
+
 void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Data &data) {
   Data::Builder db(data, &s_dp);
   bool has_authority = false;
+
+  // A change of SETTINGS_HEADER_TABLE_SIZE from the peer has to be
+  // acknowledged by a table size update at the start of the next block.
+  // Trailers are sent later than they are encoded, so they repeat the
+  // update but leave it pending for the next header block to carry.
+  auto peer_table_size = m_peer_settings.header_table_size;
+  if (peer_table_size != m_peer_table_size) {
+    m_peer_table_size = peer_table_size;
+    m_index_table.resize(std::min(peer_table_size, int(MAX_TABLE_SIZE)));
+    m_table_size_changed = true;
+  }
+  if (m_table_size_changed) {
+    encode_int(db, 0x20, 3, m_index_table.capacity());
+    if (!is_tail) m_table_size_changed = false;
+  }
+
   if (!is_tail) {
     if (is_response) {
       pjs::Ref<http::ResponseHead> h = pjs::coerce<http::ResponseHead>(head);
       auto status = h->status;
       if (status == 200) {
-        encode_header_field(db, s_colon_status, s_200);
+        encode_header_field(db, s_colon_status, s_200, is_tail);
       } else {
         pjs::Ref<pjs::Str> str(pjs::Str::make(status));
-        encode_header_field(db, s_colon_status, str);
+        encode_header_field(db, s_colon_status, str, is_tail);
       }
 
     } else {
@@ -1150,12 +1236,12 @@ void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Da
       if (!scheme || !scheme->length()) scheme = s_http;
       if (!path || !path->length()) path = s_root_path;
 
-      encode_header_field(db, s_colon_method, method);
-      encode_header_field(db, s_colon_scheme, scheme);
-      encode_header_field(db, s_colon_path, path);
+      encode_header_field(db, s_colon_method, method, is_tail);
+      encode_header_field(db, s_colon_scheme, scheme, is_tail);
+      encode_header_field(db, s_colon_path, path, is_tail);
 
       if (authority && authority->length() > 0) {
-        encode_header_field(db, s_colon_authority, authority);
+        encode_header_field(db, s_colon_authority, authority, is_tail);
         has_authority = true;
       }
     }
@@ -1181,13 +1267,13 @@ void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Da
             v.as<pjs::Array>()->iterate_all(
               [&](pjs::Value &v, int) {
                 auto s = v.to_string();
-                encode_header_field(db, k, s);
+                encode_header_field(db, k, s, is_tail);
                 s->release();
               }
             );
           } else {
             auto s = v.to_string();
-            encode_header_field(db, k, s);
+            encode_header_field(db, k, s, is_tail);
             s->release();
           }
         }
@@ -1198,20 +1284,69 @@ void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Da
   db.flush();
 }
 
-void HeaderEncoder::encode_header_field(Data::Builder &db, pjs::Str *k, pjs::Str *v) {
-  if (const auto *ent = m_static_table.find(k)) {
+void HeaderEncoder::encode_header_field(Data::Builder &db, pjs::Str *k, pjs::Str *v, bool is_tail) {
+  pjs::Ref<pjs::Str> name(k);
+  for (auto c : k->str()) {
+    if (std::isupper(c)) {
+      auto s = k->str();
+      for (auto &c : s) c = std::tolower(c);
+      name = pjs::Str::make(std::move(s));
+      break;
+    }
+  }
+
+  int name_index = 0;
+  if (const auto *ent = m_static_table.find(name)) {
     auto i = ent->values.find(v);
-    if (i == ent->values.end()) {
-      encode_int(db, 0x00, 4, ent->index);
-      encode_str(db, v, false);
-    } else {
+    if (i != ent->values.end()) {
       encode_int(db, 0x80, 1, i->second);
+      return;
+    }
+    name_index = ent->index;
+  }
+
+  // Trailers are held back until the body is sent, by when the
+  // dynamic table may have moved on, so they only use the static table
+  bool use_table = (m_indexing && !is_tail);
+
+  if (use_table) {
+    int dynamic_name_index = 0;
+    if (auto i = m_index_table.find(name, v, dynamic_name_index)) {
+      encode_int(db, 0x80, 1, m_static_table.size() + i);
+      return;
     }
+    if (!name_index && dynamic_name_index) {
+      name_index = m_static_table.size() + dynamic_name_index;
+    }
+  }
+
+  if (
+    m_never_index.count(name) > 0 ||
+    (name == s_cookie && v->size() < 20)
+  ) {
+    encode_int(db, 0x10, 4, name_index);
+  } else if (
+    use_table &&
+    name != s_colon_path &&
+    name != s_content_length &&
+    name != s_age &&
+    name != s_date &&
+    name != s_etag &&
+    name != s_if_modified_since &&
+    name != s_if_none_match &&
+    name != s_last_modified &&
+    name != s_location &&
+    name != s_set_cookie &&
+    32 + name->size() + v->size() <= m_index_table.capacity() * 3 / 4
+  ) {
+    encode_int(db, 0x40, 2, name_index);
+    m_index_table.add(name, v);
   } else {
-    encode_int(db, 0x00, 4, 0);
-    encode_str(db, k, true);
-    encode_str(db, v, false);
+    encode_int(db, 0x00, 4, name_index);
   }
+
+  if (!name_index) encode_str(db, name);
+  encode_str(db, v);
 }
 
 void HeaderEncoder::encode_int(Data::Builder &db, uint8_t prefix, int prefix_len, uint32_t n) {
@@ -1221,28 +1356,45 @@ void HeaderEncoder::encode_int(Data::Builder &db, uint8_t prefix, int prefix_len
   } else {
     db.push(uint8_t(prefix | mask));
     n -= mask;
-    while (n) {
-      if (n >> 7) {
-        db.push(uint8_t(0x80 | (n & 0x7f)));
-      } else {
-        db.push(uint8_t(n & 0x7f));
-      }
+    while (n >> 7) {
+      db.push(uint8_t(0x80 | (n & 0x7f)));
       n >>= 7;
     }
-  }
-}
-
-void HeaderEncoder::encode_str(Data::Builder &db, pjs::Str *s, bool lowercase) {
-  encode_int(db, 0, 1, s->size());
-  if (lowercase) {
-    for (auto ch : s->str()) {
-      db.push(char(std::tolower(ch)));
+    db.push(uint8_t(n));
+  }
+}
+
+void HeaderEncoder::encode_str(Data::Builder &db, pjs::Str *s) {
+  const auto &str = s->str();
+  size_t bits = 0;
+  for (auto c : str) bits += s_hpack_huffman_table[uint8_t(c)].bits;
+  auto size = (bits + 7) >> 3;
+  if (size < str.length()) {
+    encode_int(db, 0x80, 1, size);
+    uint64_t buf = 0;
+    int n = 0;
+    for (auto c : str) {
+      const auto &h = s_hpack_huffman_table[uint8_t(c)];
+      buf = (buf << h.bits) | h.code;
+      n += h.bits;
+      while (n >= 8) {
+        n -= 8;
+        db.push(uint8_t(buf >> n));
+      }
+    }
+    if (n > 0) {
+      db.push(uint8_t((buf << (8 - n)) | (0xff >> n))); // padded with the EOS prefix
     }
   } else {
-    db.push(s->str());
+    encode_int(db, 0x00, 1, str.length());
+    db.push(str);
   }
 }
 
+//
+// HeaderEncoder::StaticTable
+//
+
 HeaderEncoder::StaticTable::StaticTable() {
   int n = sizeof(s_hpack_static_table) / sizeof(s_hpack_static_table[0]);
   for (int i = 0; i < n; i++) {
@@ -1252,6 +1404,7 @@ HeaderEncoder::StaticTable::StaticTable() {
     if (!ent.index) ent.index = i + 1;
     if (f.value) ent.values[pjs::Str::make(f.value)] = i + 1;
   }
+  m_size = n;
 }
 
 auto HeaderEncoder::StaticTable::find(pjs::Str *name) -> const Entry* {
@@ -1260,6 +1413,51 @@ auto HeaderEncoder::StaticTable::find(pjs::Str *name) -> const Entry* {
   return &i->second;
 }
 
+//
+// HeaderEncoder::IndexTable
+//
+
+void HeaderEncoder::IndexTable::reset() {
+  m_fields.clear();
+  m_field_ids.clear();
+  m_name_ids.clear();
+  m_size = 0;
+}
+
+auto HeaderEncoder::IndexTable::find(pjs::Str *name, pjs::Str *value, int &name_index) const -> int {
+  auto i = m_field_ids.find(std::make_pair(name, value));
+  if (i != m_field_ids.end()) return int(m_last_id - i->second + 1);
+  auto j = m_name_ids.find(name);
+  name_index = (j == m_name_ids.end() ? 0 : int(m_last_id - j->second + 1));
+  return 0;
+}
+
+void HeaderEncoder::IndexTable::add(pjs::Str *name, pjs::Str *value) {
+  auto size = 32 + name->size() + value->size();
+  if (size > m_capacity) {
+    reset(); // an entry too large for the table empties it
+    return;
+  }
+  auto id = ++m_last_id;
+  m_fields.push_back({ name, value, id });
+  m_field_ids[std::make_pair(name, value)] = id;
+  m_name_ids[name] = id;
+  m_size += size;
+  evict();
+}
+
+void HeaderEncoder::IndexTable::evict() {
+  while (m_size > m_capacity) {
+    auto &f = m_fields.front();
+    auto i = m_field_ids.find(std::make_pair(f.name.get(), f.value.get()));
+    if (i != m_field_ids.end() && i->second == f.id) m_field_ids.erase(i);
+    auto j = m_name_ids.find(f.name.get());
+    if (j != m_name_ids.end() && j->second == f.id) m_name_ids.erase(j);
+    m_size -= 32 + f.name->size() + f.value->size();
+    m_fields.pop_front();
+  }
+}
+
 //
 // Endpoint
 //
@@ -1277,15 +1475,34 @@ Endpoint::Options::Options(pjs::Object *options) {
   Value(options, "streamWindowSize")
     .get_binary_size(stream_window_size)
     .check_nullable();
+  Value(options, "headerIndexing")
+    .get(header_indexing)
+    .check_nullable();
+  Value(options, "sensitiveHeaders")
+    .get(sensitive_headers)
+    .check_nullable();
 }
 
 Endpoint::Endpoint(bool is_server_side, const Options &options)
   : m_id(s_endpoint_id.fetch_add(1, std::memory_order_relaxed))
   , m_options(options)
   , m_header_decoder(m_settings)
+  , m_header_encoder(m_peer_settings)
   , m_is_server_side(is_server_side)
 {
   init_metrics();
+  m_header_encoder.indexing(options.header_indexing);
+  if (auto a = options.sensitive_headers.get()) {
+    a->iterate_all(
+      [this](pjs::Value &v, int) {
+        auto s = v.to_string();
+        auto name = s->str();
+        for (auto &c : name) c = std::tolower(c);
+        m_header_encoder.never_index(pjs::Str::make(std::move(name)));
+        s->release();
+      }
+    );
+  }
   m_settings.enable_push = false;
   m_settings.initial_window_size = options.stream_window_size;
   m_recv_window_max = options.connection_window_size;
@@ -1302,6 +1519,7 @@ void Endpoint::reset() {
   m_streams.clear();
   m_streams_pending.clear();
   m_header_decoder.reset();
+  m_header_encoder.reset();
   m_peer_settings = Settings();
   m_output_buffer.clear();
   m_last_received_stream_id = 0;
@@ -37,7 +37,9 @@
 #include "demux.hpp"
 #include "options.hpp"
 
+#include <deque>
 #include <map>
+#include <set>
 #include <vector>
 #include <iostream>
 
@@ -239,14 +241,6 @@ private:
     VALUE_STRING,
   };
 
-  struct Huffman {
-    uint16_t left = 0;
-    union {
-      uint16_t right = 0;
-      uint16_t code;
-    };
-  };
-
   const Settings& m_settings;
   State m_state;
   ErrorCode m_error;
@@ -291,20 +285,40 @@ private:
   };
 
   //
-  // HeaderDecoder::HuffmanTree
+  // HeaderDecoder::HuffmanTable
+  //
+  // A state machine consuming 4 bits at a time, where states are the
+  // internal nodes of the Huffman tree. No code is shorter than 5 bits,
+  // so each transition emits at most one symbol.
   //
 
-  class HuffmanTree {
+  class HuffmanTable {
   public:
-    HuffmanTree();
-    auto get() const -> const std::vector<Huffman>& { return m_tree; }
+    enum {
+      EMIT   = 0x01, // a symbol is decoded by this transition
+      ACCEPT = 0x02, // the string can end in the next state
+      FAIL   = 0x04, // EOS decoded
+    };
+
+    struct Transition {
+      uint8_t state;
+      uint8_t flags;
+      uint8_t symbol;
+    };
+
+    HuffmanTable();
+
+    auto get(uint8_t state, uint8_t nibble) const -> const Transition& {
+      return m_table[(state << 4) | nibble];
+    }
+
   private:
-    std::vector<Huffman> m_tree;
+    std::vector<Transition> m_table;
   };
 
   thread_local
   static const StaticTable s_static_table;
-  static const HuffmanTree s_huffman_tree;
+  static const HuffmanTable s_huffman_table;
 };
 
 //
@@ -313,6 +327,12 @@ private:
 
 class HeaderEncoder {
 public:
+  HeaderEncoder(const Settings &peer_settings);
+
+  void reset();
+  void indexing(bool b) { m_indexing = b; }
+  void never_index(pjs::Str *name) { m_never_index.insert(name); }
+
   void encode(
     bool is_response,
     bool is_tail,
@@ -321,14 +341,19 @@ public:
   );
 
 private:
+  enum {
+    MAX_TABLE_SIZE = Settings::DEFAULT_HEADER_TABLE_SIZE,
+  };
+
   void encode_header_field(
     Data::Builder &db,
     pjs::Str *k,
-    pjs::Str *v
+    pjs::Str *v,
+    bool is_tail
   );
 
   void encode_int(Data::Builder &db, uint8_t prefix, int prefix_len, uint32_t n);
-  void encode_str(Data::Builder &db, pjs::Str *s, bool lowercase);
+  void encode_str(Data::Builder &db, pjs::Str *s);
 
   struct Entry {
     int index = 0;
@@ -343,10 +368,51 @@ private:
   public:
     StaticTable();
     auto find(pjs::Str *name) -> const Entry*;
+    auto size() const -> int { return m_size; }
   private:
     std::map<pjs::Ref<pjs::Str>, Entry> m_table;
+    int m_size = 0;
   };
 
+  //
+  // HeaderEncoder::IndexTable
+  //
+  // Mirrors the peer decoder's dynamic table so that
+  // previously sent fields can be referred to by index
+  //
+
+  class IndexTable {
+  public:
+    void reset();
+    auto capacity() const -> size_t { return m_capacity; }
+    void resize(size_t size) { m_capacity = size; evict(); }
+    auto find(pjs::Str *name, pjs::Str *value, int &name_index) const -> int;
+    void add(pjs::Str *name, pjs::Str *value);
+
+  private:
+    struct Field {
+      pjs::Ref<pjs::Str> name;
+      pjs::Ref<pjs::Str> value;
+      size_t id;
+    };
+
+    std::deque<Field> m_fields;
+    std::map<std::pair<pjs::Str*, pjs::Str*>, size_t> m_field_ids;
+    std::map<pjs::Str*, size_t> m_name_ids;
+    size_t m_capacity = Settings::DEFAULT_HEADER_TABLE_SIZE;
+    size_t m_size = 0;
+    size_t m_last_id = 0;
+
+    void evict();
+  };
+
+  const Settings& m_peer_settings;
+  IndexTable m_index_table;
+  std::set<pjs::Ref<pjs::Str>> m_never_index;
+  int m_peer_table_size = Settings::DEFAULT_HEADER_TABLE_SIZE;
+  bool m_table_size_changed = false;
+  bool m_indexing = true;
+
   thread_local static StaticTable m_static_table;
 };
 
@@ -363,6 +429,8 @@ public:
   struct Options : public pipy::Options {
     size_t connection_window_size = 0x100000;
     size_t stream_window_size = 0x100000;
+    bool header_indexing = true;
+    pjs::Ref<pjs::Array> sensitive_headers;
     Options() {}
     Options(pjs::Object *options);
   };
@@ -30,6 +30,10 @@
 #include "constants.hpp"
 #include "log.hpp"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #ifdef __linux__
 #include <linux/netfilter_ipv4.h>
 #include <linux/ip.h>
@@ -261,6 +265,7 @@ void InboundTCP::accept(asio::ip::tcp::acceptor &acceptor) {
     socket(), m_peer,
     [this](const std::error_code &ec) {
       InputContext ic(this);
+      m_accepting = false;
 
       if (ec == asio::error::operation_aborted) {
         dangle();
@@ -270,8 +275,13 @@ void InboundTCP::accept(asio::ip::tcp::acceptor &acceptor) {
           restart();
 
         } else if (m_listener && m_listener->pipeline_layout()) {
-          log_debug("connection accepted");
-          start();
+          if (m_listener->hand_off(socket(), m_peer)) {
+            log_debug("connection handed off");
+            restart();
+          } else {
+            log_debug("connection accepted");
+            start();
+          }
         }
       }
 
@@ -279,9 +289,28 @@ void InboundTCP::accept(asio::ip::tcp::acceptor &acceptor) {
     }
   );
 
+  m_accepting = true;
   retain();
 }
 
+void InboundTCP::adopt(int fd, const asio::ip::tcp::endpoint &peer) {
+  InputContext ic(this);
+  retain();
+  std::error_code ec;
+  m_peer = peer;
+  socket().assign(peer.protocol(), fd, ec);
+  if (ec) {
+    log_error("error adopting connection", ec);
+#ifndef _WIN32
+    ::close(fd);
+#endif
+  } else {
+    log_debug("connection adopted");
+    start();
+  }
+  release();
+}
+
 auto InboundTCP::get_socket() -> Socket* {
   if (!m_socket) {
     m_socket = Socket::make(SocketTCP::socket().native_handle());
@@ -139,7 +139,9 @@ class InboundTCP :
 {
 public:
   void accept(asio::ip::tcp::acceptor &acceptor);
+  void adopt(int fd, const asio::ip::tcp::endpoint &peer);
   void cancel() { m_canceled = true; }
+  bool accepting() const { return m_accepting; }
 
 private:
   InboundTCP(Listener *listener, const Inbound::Options &options);
@@ -147,6 +149,7 @@ private:
 
   pjs::Ref<Socket> m_socket;
   asio::ip::tcp::endpoint m_peer;
+  bool m_accepting = false;
   bool m_canceled = false;
 
   virtual auto get_socket() -> Socket* override;
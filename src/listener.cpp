@@ -24,11 +24,16 @@
  */
 
 #include "listener.hpp"
+#include "accept-lb.hpp"
 #include "pipeline.hpp"
 #include "worker.hpp"
 #include "worker-thread.hpp"
 #include "log.hpp"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 namespace pipy {
 
 //
@@ -350,6 +355,7 @@ void Listener::stop() {
     m_keep_alive->fire();
     m_keep_alive = nullptr;
   }
+  update_load();
 }
 
 void Listener::accept() {
@@ -370,6 +376,7 @@ void Listener::open(Inbound *inbound) {
     pause();
   }
   m_peak_connections = std::max(m_peak_connections, int(m_inbounds.size()));
+  update_load();
   if (Log::is_enabled(Log::LISTENER)) print_state("accept");
 }
 
@@ -381,6 +388,7 @@ void Listener::close(Inbound *inbound) {
   if ((max < 0 || n < max) && port_has_room) {
     resume();
   }
+  update_load();
   if (Log::is_enabled(Log::LISTENER)) print_state("finish");
 }
 
@@ -438,6 +446,48 @@ void Listener::set_sock_opts(int sock) {
   }
 }
 
+bool Listener::hand_off(asio::ip::tcp::socket &socket, const asio::ip::tcp::endpoint &peer) {
+#ifndef _WIN32
+  if (AcceptLoadBalancer::mode() != AcceptLoadBalancer::Mode::HANDOFF) return false;
+  auto target = AcceptLoadBalancer::pick();
+  if (target < 0) return false;
+
+  std::error_code ec;
+  int fd = socket.release(ec);
+  if (ec) return false;
+
+  auto origin = WorkerThread::current()->index();
+  auto ip = m_port->ip();
+  auto port = m_port->num();
+
+  AcceptLoadBalancer::handed_off(target);
+  if (!AcceptLoadBalancer::post(target, [=]() { adopt(ip, port, fd, peer, origin); })) {
+    m_net.post([=]() { adopt(ip, port, fd, peer, -1); });
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Listener::adopt(const std::string &ip, int port, int fd, const asio::ip::tcp::endpoint &peer, int origin) {
+#ifndef _WIN32
+  if (origin >= 0) AcceptLoadBalancer::handed_in();
+  auto *l = find(Port::Protocol::TCP, ip, port);
+  if (l && l->m_acceptor && l->m_pipeline_layout) {
+    static_cast<AcceptorTCP*>(l->m_acceptor.get())->adopt(fd, peer);
+  } else if (origin < 0 || !AcceptLoadBalancer::post(origin, [=]() { adopt(ip, port, fd, peer, -1); })) {
+    ::close(fd);
+  }
+#endif
+}
+
+void Listener::update_load() {
+  if (AcceptLoadBalancer::mode() != AcceptLoadBalancer::Mode::OFF) {
+    AcceptLoadBalancer::update(Inbound::count());
+  }
+}
+
 auto Listener::find(Port::Protocol protocol, const std::string &ip, int port) -> Listener* {
   for (auto *l : s_listeners) {
     if (l->protocol() == protocol && l->ip() == ip && l->port() == port) {
@@ -469,14 +519,24 @@ void Listener::AcceptorTCP::start(const asio::ip::tcp::endpoint &endpoint) {
 
   m_acceptor.bind(endpoint);
   m_acceptor.listen(asio::socket_base::max_connections);
+
+  if (AcceptLoadBalancer::mode() == AcceptLoadBalancer::Mode::EBPF) {
+    AcceptLoadBalancer::attach(m_listener->ip(), m_listener->port(), m_acceptor.native_handle());
+  }
 }
 
 void Listener::AcceptorTCP::accept() {
+  if (m_accepting && m_accepting->accepting()) return;
   auto inbound = InboundTCP::make(m_listener, m_listener->m_options);
   inbound->accept(m_acceptor);
   m_accepting = inbound;
 }
 
+void Listener::AcceptorTCP::adopt(int fd, const asio::ip::tcp::endpoint &peer) {
+  auto inbound = InboundTCP::make(m_listener, m_listener->m_options);
+  inbound->adopt(fd, peer);
+}
+
 void Listener::AcceptorTCP::cancel() {
   m_acceptor.cancel();
   if (m_accepting) {
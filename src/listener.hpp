@@ -183,6 +183,8 @@ private:
     virtual void cancel() override;
     virtual void stop() override;
 
+    void adopt(int fd, const asio::ip::tcp::endpoint &peer);
+
   private:
     Listener* m_listener;
     asio::ip::tcp::acceptor m_acceptor;
@@ -230,6 +232,7 @@ private:
   void print_state(const char *msg);
   void describe(char *buf, size_t len);
   void set_sock_opts(int sock);
+  bool hand_off(asio::ip::tcp::socket &socket, const asio::ip::tcp::endpoint &peer);
 
   Net& m_net;
   Options m_options;
@@ -251,9 +254,12 @@ private:
   static bool s_reuse_port;
 
   static auto find(Port::Protocol protocol, const std::string &ip, int port) -> Listener*;
+  static void adopt(const std::string &ip, int port, int fd, const asio::ip::tcp::endpoint &peer, int origin);
+  static void update_load();
 
   friend class Port;
   friend class Inbound;
+  friend class InboundTCP;
   friend class pjs::RefCount<Listener>;
 };
 
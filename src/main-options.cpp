@@ -75,12 +75,15 @@ void MainOptions::show_help() {
   std::cout << "  --no-status                          Do not report current status to the repo" << std::endl;
   std::cout << "  --no-metrics                         Do not report metrics to the repo" << std::endl;
   std::cout << "  --trace-objects                      Enable tracing the locations of object construction" << std::endl;
+  std::cout << "  --bytecode                           Run script functions with the bytecode interpreter" << std::endl;
   std::cout << "  --force-start                        Force to start even at failure of address/port binding" << std::endl;
   std::cout << "  --init-repo=<dirname>                Populate the repo with codebases under the specified directory" << std::endl;
   std::cout << "  --init-code=<codebase>               Start running the specified codebase after repo initialization" << std::endl;
   std::cout << "  --instance-uuid=<uuid>               Specify a UUID for this worker process" << std::endl;
   std::cout << "  --instance-name=<name>               Specify a name for this worker process" << std::endl;
   std::cout << "  --reuse-port                         Enable kernel load balancing for all listening ports" << std::endl;
+  std::cout << "  --io-uring                           Use io_uring instead of the default reactor for TCP sockets (Linux only)" << std::endl;
+  std::cout << "  --balance-accept=<off|handoff|ebpf>  Move accepted connections to the least loaded worker thread" << std::endl;
   std::cout << "  --admin-port=<[[ip]:]port>           Enable administration service on the specified port" << std::endl;
   std::cout << "  --admin-port-off                     Do not start administration service at startup" << std::endl;
   std::cout << "  --admin-gui=<dirname>                Specify the location of administration GUI front-end files" << std::endl;
@@ -250,6 +253,8 @@ void MainOptions::parse(const std::list<std::string> &args) {
         no_metrics = true;
       } else if (k == "--trace-objects") {
         trace_objects = true;
+      } else if (k == "--bytecode") {
+        bytecode = true;
       } else if (k == "--force-start") {
         force_start = true;
       } else if (k == "--init-repo") {
@@ -262,6 +267,13 @@ void MainOptions::parse(const std::list<std::string> &args) {
         instance_name = v;
       } else if (k == "--reuse-port") {
         reuse_port = true;
+      } else if (k == "--io-uring") {
+        io_uring = true;
+      } else if (k == "--balance-accept") {
+        if (v == "off") balance_accept = AcceptLoadBalancer::Mode::OFF;
+        else if (v == "handoff" || v.empty()) balance_accept = AcceptLoadBalancer::Mode::HANDOFF;
+        else if (v == "ebpf") balance_accept = AcceptLoadBalancer::Mode::EBPF;
+        else throw std::runtime_error("unknown accept balancing mode: " + v);
       } else if (k == "--admin-port-off") {
         admin_port_off = true;
       } else if (k == "--admin-port") {
@@ -378,12 +390,19 @@ auto MainOptions::to_string() -> std::string {
   if (no_status) list.push_back("--no-status");
   if (no_metrics) list.push_back("--no-metrics");
   if (trace_objects) list.push_back("--trace-objects");
+  if (bytecode) list.push_back("--bytecode");
   if (force_start) list.push_back("--force-start");
   if (!init_repo.empty()) list.push_back("--init-repo=" + init_repo);
   if (!init_code.empty()) list.push_back("--init-code=" + init_code);
   if (!instance_uuid.empty()) list.push_back("--instance-uuid" + instance_uuid);
   if (!instance_name.empty()) list.push_back("--instance-name" + instance_name);
   if (reuse_port) list.push_back("--reuse-port");
+  if (io_uring) list.push_back("--io-uring");
+  switch (balance_accept) {
+    case AcceptLoadBalancer::Mode::OFF: break;
+    case AcceptLoadBalancer::Mode::HANDOFF: list.push_back("--balance-accept=handoff"); break;
+    case AcceptLoadBalancer::Mode::EBPF: list.push_back("--balance-accept=ebpf"); break;
+  }
   if (admin_port_off) list.push_back("--admin-port-off");
   if (!admin_port.empty()) list.push_back("--admin-port=" + admin_port);
   if (!admin_gui.empty()) list.push_back("--admin-gui=" + admin_gui);
@@ -27,6 +27,7 @@
 #define MAIN_OPTIONS_HPP
 
 #include "api/crypto.hpp"
+#include "accept-lb.hpp"
 #include "log.hpp"
 
 #include <list>
@@ -55,8 +56,11 @@ public:
   bool        no_status = false;
   bool        no_metrics = false;
   bool        trace_objects = false;
+  bool        bytecode = false;
   bool        force_start = false;
   bool        reuse_port = false;
+  bool        io_uring = false;
+  AcceptLoadBalancer::Mode balance_accept = AcceptLoadBalancer::Mode::OFF;
   int         threads = 1;
   std::string log_file;
   Log::Level  log_level = Log::INFO;
@@ -429,8 +429,11 @@ int pipy_main(int argc, char *argv[]) {
     Log::set_local_only(opts.log_local_only);
     Log::init();
     logging::Logger::set_history_size(opts.log_history_limit);
-    Listener::set_reuse_port(opts.reuse_port);
+    Listener::set_reuse_port(opts.reuse_port || opts.balance_accept == AcceptLoadBalancer::Mode::EBPF);
+    AcceptLoadBalancer::set_mode(opts.balance_accept);
+    Net::set_io_uring(opts.io_uring);
     pjs::Class::set_tracing(opts.trace_objects);
+    pjs::Bytecode::enable(opts.bytecode);
     pjs::Math::init();
     crypto::Crypto::init(opts.openssl_engine);
     tls::TLSSession::init();
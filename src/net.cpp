@@ -24,9 +24,12 @@
  */
 
 #include "net.hpp"
+#include "uring.hpp"
+#include "log.hpp"
 
 namespace pipy {
 
+bool Net::s_io_uring_enabled = false;
 Net* Net::s_main = nullptr;
 thread_local Net Net::s_current;
 
@@ -38,6 +41,22 @@ void Net::init() {
 #endif
 }
 
+void Net::set_io_uring(bool enabled) {
+#ifndef PIPY_USE_IO_URING
+  if (enabled) {
+    Log::warn("[io_uring] io_uring is not supported by this build, using the default reactor");
+    enabled = false;
+  }
+#endif
+  s_io_uring_enabled = enabled;
+}
+
+Net::~Net() {
+#ifdef PIPY_USE_IO_URING
+  delete m_io_uring;
+#endif
+}
+
 void Net::run() {
   m_is_running = true;
   m_io_context.run();
@@ -67,4 +86,19 @@ void Net::defer(const std::function<void()> &cb) {
   asio::defer(m_io_context, cb);
 }
 
+auto Net::make_io_uring() -> IOUring* {
+#ifdef PIPY_USE_IO_URING
+  if (!m_io_uring_failed) {
+    try {
+      m_io_uring = new IOUring(m_io_context);
+      Log::debug(Log::SOCKET, "[io_uring] ring created");
+    } catch (std::runtime_error &err) {
+      m_io_uring_failed = true;
+      Log::error("[io_uring] %s, using the default reactor instead", err.what());
+    }
+  }
+#endif
+  return m_io_uring;
+}
+
 } // namespace pipy
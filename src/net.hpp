@@ -36,6 +36,8 @@
 
 namespace pipy {
 
+class IOUring;
+
 //
 // Net
 //
@@ -43,6 +45,7 @@ namespace pipy {
 class Net {
 public:
   static void init();
+  static void set_io_uring(bool enabled);
 
   static auto main() -> Net& {
     return *s_main;
@@ -58,9 +61,16 @@ public:
 
   static bool is_main() { return &s_current == s_main; }
 
+  ~Net();
+
   auto io_context() -> asio::io_context& { return m_io_context; }
   bool is_running() const { return m_is_running; }
 
+  auto io_uring() -> IOUring* {
+    if (m_io_uring || !s_io_uring_enabled) return m_io_uring;
+    return make_io_uring();
+  }
+
   void run();
   auto run_one() -> size_t;
   void stop();
@@ -70,7 +80,13 @@ public:
 
 private:
   asio::io_context m_io_context;
+  IOUring* m_io_uring = nullptr;
+  bool m_io_uring_failed = false;
   bool m_is_running;
+
+  auto make_io_uring() -> IOUring*;
+
+  static bool s_io_uring_enabled;
   static Net* s_main;
   static thread_local Net s_current;
 };
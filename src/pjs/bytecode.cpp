@@ -0,0 +1,254 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bytecode.hpp"
+#include "expr.hpp"
+
+#if defined(__GNUC__)
+#define PJS_COMPUTED_GOTO
+#endif
+
+namespace pjs {
+
+using namespace expr;
+
+//
+// Bytecode::Builder
+//
+
+auto Bytecode::Builder::emit(Op op, int r, int a, int b, int n, Expr *expr) -> int {
+  if (op != Op::EVAL && op != Op::END) m_native++;
+  m_code.push_back({ op, r, a, b, n, expr });
+  return m_code.size() - 1;
+}
+
+//
+// Registers
+//
+// Carved out of a per-thread stack so that a call neither touches
+// the heap nor constructs more values than the function really uses.
+//
+
+class Registers {
+public:
+  Registers(int n) : m_size(n) {
+    auto &s = s_stack;
+    if (s.top + n <= STACK_SIZE) {
+      if (!s.values) s.values = new Value[STACK_SIZE];
+      m_values = s.values + s.top;
+      m_heap = nullptr;
+      s.top += n;
+    } else {
+      m_values = m_heap = new Value[n];
+    }
+  }
+
+  ~Registers() {
+    if (m_heap) {
+      delete [] m_heap;
+    } else {
+      for (int i = 0; i < m_size; i++) m_values[i] = Value::undefined;
+      s_stack.top -= m_size;
+    }
+  }
+
+  auto data() const -> Value* { return m_values; }
+
+private:
+  static const int STACK_SIZE = 4096;
+
+  struct Stack {
+    Value* values = nullptr;
+    int top = 0;
+    ~Stack() { delete [] values; }
+  };
+
+  int m_size;
+  Value* m_values;
+  Value* m_heap;
+
+  thread_local static Stack s_stack;
+};
+
+thread_local Registers::Stack Registers::s_stack;
+
+//
+// Bytecode
+//
+
+bool Bytecode::s_enabled = false;
+
+auto Bytecode::compile(Expr *expr) -> Bytecode* {
+  Builder b;
+  expr->compile(b, b.alloc());
+  b.emit(Op::END);
+  if (!b.m_native) return nullptr;
+  auto code = new Bytecode;
+  code->m_code = std::move(b.m_code);
+  code->m_constants = std::move(b.m_constants);
+  code->m_registers = b.m_registers;
+  return code;
+}
+
+bool Bytecode::run(Context &ctx, Value &result) {
+  Registers registers(m_registers);
+  auto *R = registers.data();
+  auto *K = m_constants.data();
+  auto *code = m_code.data();
+  auto *i = code;
+
+#ifdef PJS_COMPUTED_GOTO
+  static const void* labels[] = {
+    &&op_END,
+    &&op_EVAL,
+    &&op_CONST,
+    &&op_LOCAL,
+    &&op_GET,
+    &&op_GET_KEY,
+    &&op_NOT,
+    &&op_NEG,
+    &&op_ADD,
+    &&op_SUB,
+    &&op_MUL,
+    &&op_DIV,
+    &&op_MOD,
+    &&op_EQ,
+    &&op_NE,
+    &&op_SEQ,
+    &&op_SNE,
+    &&op_GT,
+    &&op_GE,
+    &&op_LT,
+    &&op_LE,
+    &&op_CONCAT,
+    &&op_JMP,
+    &&op_JMP_FALSE,
+    &&op_JMP_TRUE,
+    &&op_JMP_SOME,
+    &&op_FUNC,
+    &&op_CALL,
+  };
+
+  static_assert(sizeof(labels) / sizeof(labels[0]) == int(Op::CALL) + 1, "opcode table out of sync");
+
+  #define OP(name) op_##name:
+  #define DISPATCH() goto *labels[int(i->op)]
+  DISPATCH();
+#else
+  #define OP(name) case Op::name:
+  #define DISPATCH() goto dispatch
+  dispatch: switch (i->op) {
+#endif
+
+  #define NEXT() do { i++; DISPATCH(); } while (0)
+  #define JUMP() do { i = code + i->n; DISPATCH(); } while (0)
+
+  OP(END) {
+    result = R[0];
+    return true;
+  }
+  OP(EVAL) {
+    auto &r = R[i->r];
+    r = Value::undefined;
+    if (!i->expr->eval(ctx, r)) return false;
+    NEXT();
+  }
+  OP(CONST) {
+    R[i->r] = K[i->n];
+    NEXT();
+  }
+  OP(LOCAL) {
+    auto *scope = ctx.scope();
+    for (int l = i->a; l > 0; l--) scope = scope->parent();
+    R[i->r] = scope->value(i->n);
+    NEXT();
+  }
+  OP(GET) {
+    if (!static_cast<Property*>(i->expr)->get(ctx, R[i->a], R[i->b], R[i->r])) return false;
+    NEXT();
+  }
+  OP(GET_KEY) {
+    if (!static_cast<Property*>(i->expr)->get(ctx, R[i->a], K[i->n].s(), R[i->r])) return false;
+    NEXT();
+  }
+  OP(NOT) {
+    R[i->r].set(!R[i->a].to_boolean());
+    NEXT();
+  }
+  OP(NEG) { Negation::apply(R[i->a], R[i->r]); NEXT(); }
+  OP(ADD) { Addition::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(SUB) { Subtraction::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(MUL) { Multiplication::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(DIV) { Division::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(MOD) { Remainder::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(EQ) { Equality::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(NE) { Inequality::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(SEQ) { R[i->r].set(Value::is_identical(R[i->a], R[i->b])); NEXT(); }
+  OP(SNE) { R[i->r].set(!Value::is_identical(R[i->a], R[i->b])); NEXT(); }
+  OP(GT) { GreaterThan::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(GE) { GreaterThanOrEqual::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(LT) { LessThan::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(LE) { LessThanOrEqual::apply(R[i->a], R[i->b], R[i->r]); NEXT(); }
+  OP(CONCAT) {
+    Concatenation::apply(R + i->a, i->n, R[i->r]);
+    NEXT();
+  }
+  OP(JMP) {
+    JUMP();
+  }
+  OP(JMP_FALSE) {
+    if (!R[i->a].to_boolean()) JUMP();
+    NEXT();
+  }
+  OP(JMP_TRUE) {
+    if (R[i->a].to_boolean()) JUMP();
+    NEXT();
+  }
+  OP(JMP_SOME) {
+    auto &v = R[i->a];
+    if (!v.is_undefined() && !v.is_null()) JUMP();
+    NEXT();
+  }
+  OP(FUNC) {
+    if (!static_cast<Invocation*>(i->expr)->callable(ctx, R[i->a])) return false;
+    NEXT();
+  }
+  OP(CALL) {
+    if (!static_cast<Invocation*>(i->expr)->call(ctx, R[i->a], i->n, R + i->b, R[i->r])) return false;
+    NEXT();
+  }
+
+#ifndef PJS_COMPUTED_GOTO
+  }
+  return false;
+#endif
+
+  #undef OP
+  #undef DISPATCH
+  #undef NEXT
+  #undef JUMP
+}
+
+} // namespace pjs
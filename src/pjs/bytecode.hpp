@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PJS_BYTECODE_HPP
+#define PJS_BYTECODE_HPP
+
+#include "types.hpp"
+
+#include <vector>
+
+namespace pjs {
+
+class Expr;
+
+//
+// Bytecode
+//
+// Compact register code lowered from a resolved expression tree.
+// Every node writes its result into a register chosen by its parent,
+// so no moves are needed between operands. Nodes without a dedicated
+// instruction are kept as EVAL instructions that call back into the tree.
+//
+
+class Bytecode {
+public:
+  enum class Op : uint8_t {
+    END,
+    EVAL,
+    CONST,
+    LOCAL,
+    GET,
+    GET_KEY,
+    NOT,
+    NEG,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    EQ,
+    NE,
+    SEQ,
+    SNE,
+    GT,
+    GE,
+    LT,
+    LE,
+    CONCAT,
+    JMP,
+    JMP_FALSE,
+    JMP_TRUE,
+    JMP_SOME,
+    FUNC,
+    CALL,
+  };
+
+  struct Inst {
+    Op op;
+    int r;
+    int a;
+    int b;
+    int n;
+    Expr *expr;
+  };
+
+  //
+  // Bytecode::Builder
+  //
+
+  class Builder {
+  public:
+    auto alloc(int count = 1) -> int { auto r = m_registers; m_registers += count; return r; }
+    auto label() const -> int { return m_code.size(); }
+    auto constant(const Value &v) -> int { m_constants.push_back(v); return m_constants.size() - 1; }
+    auto emit(Op op, int r = 0, int a = 0, int b = 0, int n = 0, Expr *expr = nullptr) -> int;
+    void patch(int jump) { m_code[jump].n = label(); }
+    void eval(Expr *expr, int r) { emit(Op::EVAL, r, 0, 0, 0, expr); }
+
+  private:
+    std::vector<Inst> m_code;
+    std::vector<Value> m_constants;
+    int m_registers = 0;
+    int m_native = 0;
+
+    friend class Bytecode;
+  };
+
+  static void enable(bool b) { s_enabled = b; }
+  static bool enabled() { return s_enabled; }
+
+  //
+  // Returns nullptr when nothing in the tree would run natively,
+  // in which case there is no point leaving the tree walker.
+  //
+
+  static auto compile(Expr *expr) -> Bytecode*;
+
+  bool run(Context &ctx, Value &result);
+
+  auto size() const -> size_t { return m_code.size(); }
+
+private:
+  std::vector<Inst> m_code;
+  std::vector<Value> m_constants;
+  int m_registers;
+
+  static bool s_enabled;
+};
+
+} // namespace pjs
+
+#endif // PJS_BYTECODE_HPP
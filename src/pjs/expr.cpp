@@ -102,6 +102,12 @@ bool Compound::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Compound::compile(Bytecode::Builder &b, int r) {
+  for (const auto &p : m_exprs) {
+    p->compile(b, r);
+  }
+}
+
 auto Compound::reduce(Reducer &r) -> Reducer::Value* {
   size_t n = m_exprs.size();
   vl_array<Reducer::Value*> v(n);
@@ -149,6 +155,26 @@ bool Concatenation::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Concatenation::apply(const Value *v, int n, Value &result) {
+  std::string str;
+  for (int i = 0; i < n; i++) {
+    auto s = v[i].to_string();
+    str += s->str();
+    s->release();
+  }
+  result.set(str);
+}
+
+void Concatenation::compile(Bytecode::Builder &b, int r) {
+  int n = m_exprs.size();
+  auto x = b.alloc(n);
+  auto i = x;
+  for (const auto &p : m_exprs) {
+    p->compile(b, i++);
+  }
+  b.emit(Bytecode::Op::CONCAT, r, x, 0, n);
+}
+
 bool Concatenation::declare(Module *module, Scope &scope, Error &error) {
   for (const auto &p : m_exprs) {
     if (!p->declare(module, scope, error)) return false;
@@ -178,6 +204,10 @@ bool Undefined::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Undefined::compile(Bytecode::Builder &b, int r) {
+  b.emit(Bytecode::Op::CONST, r, 0, 0, b.constant(Value::undefined));
+}
+
 auto Undefined::reduce(Reducer &r) -> Reducer::Value* {
   return r.undefined();
 }
@@ -195,6 +225,10 @@ bool Null::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Null::compile(Bytecode::Builder &b, int r) {
+  b.emit(Bytecode::Op::CONST, r, 0, 0, b.constant(Value::null));
+}
+
 auto Null::reduce(Reducer &r) -> Reducer::Value* {
   return r.null();
 }
@@ -212,6 +246,10 @@ bool BooleanLiteral::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void BooleanLiteral::compile(Bytecode::Builder &b, int r) {
+  b.emit(Bytecode::Op::CONST, r, 0, 0, b.constant(Value(m_b)));
+}
+
 auto BooleanLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.boolean(m_b);
 }
@@ -229,6 +267,10 @@ bool NumberLiteral::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void NumberLiteral::compile(Bytecode::Builder &b, int r) {
+  b.emit(Bytecode::Op::CONST, r, 0, 0, b.constant(Value(m_n)));
+}
+
 auto NumberLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.number(m_n);
 }
@@ -246,6 +288,10 @@ bool StringLiteral::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void StringLiteral::compile(Bytecode::Builder &b, int r) {
+  b.emit(Bytecode::Op::CONST, r, 0, 0, b.constant(Value(m_s.get())));
+}
+
 auto StringLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.string(m_s->str());
 }
@@ -327,13 +373,12 @@ bool ObjectLiteral::unpack(Context &ctx, Value &arg, int &var) {
 
 bool ObjectLiteral::eval(Context &ctx, Value &result) {
   auto obj = Object::make(m_class);
-  auto data = obj->data();
   result.set(obj);
   for (const auto &e : m_entries) {
     auto k = e.key.get();
     auto v = e.value.get();
     if (e.index >= 0) {
-      if (!v->eval(ctx, data->at(e.index))) return false;
+      if (!v->eval(ctx, obj->data()->at(e.index))) return false;
     } else if (!k) {
       Value val; if (!v->eval(ctx, val)) return false;
       if (val.is_object()) {
@@ -558,6 +603,11 @@ void FunctionLiteral::resolve(Module *module, Context &ctx, int l, LegacyImports
     name, [this](Context &ctx, Object*, Value &result) {
       auto scope = m_scope.instantiate(ctx);
       if (!scope) return;
+      if (m_code && Bytecode::enabled()) {
+        m_code->run(ctx, result);
+        scope->clear();
+        return;
+      }
       Stmt::Result res;
       m_output->execute(ctx, res);
       if (ctx.ok()) {
@@ -574,6 +624,19 @@ void FunctionLiteral::resolve(Module *module, Context &ctx, int l, LegacyImports
   Context fctx(ctx, 0, nullptr, pjs::Scope::make(ctx.instance(), ctx.scope(), m_scope.size(), m_scope.variables()));
   for (auto &i : m_inputs) i->resolve(module, fctx, l, imports);
   m_output->resolve(module, fctx, l, imports);
+
+  // Only bodies that boil down to a single returned expression are
+  // lowered to bytecode, anything else stays with the tree walker
+  auto *output = m_output.get();
+  if (auto block = dynamic_cast<stmt::Block*>(output)) {
+    const auto &stmts = block->stmts();
+    if (stmts.size() == 1) output = stmts.front().get();
+  }
+  if (auto ret = dynamic_cast<stmt::Return*>(output)) {
+    if (auto value = ret->value()) {
+      m_code.reset(Bytecode::compile(value));
+    }
+  }
 }
 
 auto FunctionLiteral::reduce(Reducer &r) -> Reducer::Value* {
@@ -715,6 +778,10 @@ bool LocalVariable::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LocalVariable::compile(Bytecode::Builder &b, int r) {
+  b.emit(Bytecode::Op::LOCAL, r, m_level, 0, m_i);
+}
+
 bool LocalVariable::assign(Context &ctx, Value &value) {
   auto *scope = ctx.scope();
   for (int i = 0; i < m_level; i++) scope = scope->parent();
@@ -784,6 +851,14 @@ bool Identifier::eval(Context &ctx, Value &result) {
   return m_resolved->eval(ctx, result);
 }
 
+void Identifier::compile(Bytecode::Builder &b, int r) {
+  if (m_resolved) {
+    m_resolved->compile(b, r);
+  } else {
+    b.eval(this, r);
+  }
+}
+
 bool Identifier::assign(Context &ctx, Value &value) {
   if (!m_resolved) resolve(ctx);
   if (!m_resolved) return error(ctx, "unresolved identifier");
@@ -878,6 +953,28 @@ bool Property::eval(Context &ctx, Value &result) {
   Value obj, key;
   if (!m_obj->eval(ctx, obj)) return false;
   if (!m_key->eval(ctx, key)) return false;
+  return get(ctx, obj, key, result);
+}
+
+void Property::compile(Bytecode::Builder &b, int r) {
+  auto o = b.alloc();
+  m_obj->compile(b, o);
+
+  // Constant keys that can never be array indices
+  // skip the numeric check and go straight to the cache
+  if (auto s = dynamic_cast<StringLiteral*>(m_key.get())) {
+    if (!std::isfinite(Value(s->s()).to_number())) {
+      b.emit(Bytecode::Op::GET_KEY, r, o, 0, b.constant(s->s()), this);
+      return;
+    }
+  }
+
+  auto k = b.alloc();
+  m_key->compile(b, k);
+  b.emit(Bytecode::Op::GET, r, o, k, 0, this);
+}
+
+bool Property::get(Context &ctx, const Value &obj, const Value &key, Value &result) {
   if (obj.is_undefined()) return error(ctx, "cannot read property of undefined");
   if (obj.is_null()) return error(ctx, "cannot read property of null");
   auto o = obj.to_object();
@@ -897,6 +994,15 @@ bool Property::eval(Context &ctx, Value &result) {
   return true;
 }
 
+bool Property::get(Context &ctx, const Value &obj, Str *key, Value &result) {
+  if (obj.is_undefined()) return error(ctx, "cannot read property of undefined");
+  if (obj.is_null()) return error(ctx, "cannot read property of null");
+  auto o = obj.to_object();
+  m_cache.get(o, key, result);
+  o->release();
+  return true;
+}
+
 bool Property::assign(Context &ctx, Value &value) {
   Value obj, key;
   if (!m_obj->eval(ctx, obj)) return false;
@@ -1060,10 +1166,31 @@ bool Invocation::eval(Context &ctx, Value &result) {
   vl_array<Value> argv(argc);
   Value f;
   if (!m_func->eval(ctx, f)) return false;
-  if (!f.is_function()) return error(ctx, "not a function");
+  if (!callable(ctx, f)) return false;
   for (size_t i = 0; i < argc; i++) {
     if (!m_argv[i]->eval(ctx, argv[i])) return false;
   }
+  return call(ctx, f, argc, argv, result);
+}
+
+void Invocation::compile(Bytecode::Builder &b, int r) {
+  int argc = m_argv.size();
+  auto f = b.alloc();
+  auto x = b.alloc(argc);
+  m_func->compile(b, f);
+  b.emit(Bytecode::Op::FUNC, 0, f, 0, 0, this);
+  for (int i = 0; i < argc; i++) {
+    m_argv[i]->compile(b, x + i);
+  }
+  b.emit(Bytecode::Op::CALL, r, f, x, argc, this);
+}
+
+bool Invocation::callable(Context &ctx, const Value &f) {
+  if (f.is_function()) return true;
+  return error(ctx, "not a function");
+}
+
+bool Invocation::call(Context &ctx, Value &f, int argc, Value *argv, Value &result) {
   ctx.trace(m_module, line(), column());
   (*f.as<Function>())(ctx, argc, argv, result);
   if (ctx.ok()) return true;
@@ -1174,17 +1301,27 @@ void Plus::dump(std::ostream &out, const std::string &indent) {
 // Negation
 //
 
-bool Negation::eval(Context &ctx, Value &result) {
-  Value x;
-  if (!m_x->eval(ctx, x)) return false;
+void Negation::apply(const Value &x, Value &result) {
   if (x.is<Int>()) {
     result.set(x.as<Int>()->neg());
-    return true;
+    return;
   }
   result.set(-x.to_number());
+}
+
+bool Negation::eval(Context &ctx, Value &result) {
+  Value x;
+  if (!m_x->eval(ctx, x)) return false;
+  apply(x, result);
   return true;
 }
 
+void Negation::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc();
+  m_x->compile(b, x);
+  b.emit(Bytecode::Op::NEG, r, x);
+}
+
 bool Negation::declare(Module *module, Scope &scope, Error &error) {
   return m_x->declare(module, scope, error);
 }
@@ -1202,17 +1339,14 @@ void Negation::dump(std::ostream &out, const std::string &indent) {
 // Addition
 //
 
-bool Addition::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Addition::apply(const Value &a, const Value &b, Value &result) {
   if (a.is_string() || b.is_string()) {
     auto sa = a.to_string();
     auto sb = b.to_string();
     result.set(sa->str() + sb->str());
     sa->release();
     sb->release();
-    return true;
+    return;
   }
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
@@ -1220,14 +1354,28 @@ bool Addition::eval(Context &ctx, Value &result) {
     result.set(ia->add(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na + nb);
+}
+
+bool Addition::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Addition::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::ADD, r, x, x + 1);
+}
+
 bool Addition::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1249,24 +1397,35 @@ void Addition::dump(std::ostream &out, const std::string &indent) {
 // Subtraction
 //
 
-bool Subtraction::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Subtraction::apply(const Value &a, const Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->sub(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na - nb);
+}
+
+bool Subtraction::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Subtraction::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::SUB, r, x, x + 1);
+}
+
 bool Subtraction::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1288,24 +1447,35 @@ void Subtraction::dump(std::ostream &out, const std::string &indent) {
 // Multiplication
 //
 
-bool Multiplication::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Multiplication::apply(const Value &a, const Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->mul(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na * nb);
+}
+
+bool Multiplication::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Multiplication::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::MUL, r, x, x + 1);
+}
+
 bool Multiplication::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1327,24 +1497,35 @@ void Multiplication::dump(std::ostream &out, const std::string &indent) {
 // Division
 //
 
-bool Division::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Division::apply(const Value &a, const Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->div(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na / nb);
+}
+
+bool Division::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Division::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::DIV, r, x, x + 1);
+}
+
 bool Division::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1366,24 +1547,35 @@ void Division::dump(std::ostream &out, const std::string &indent) {
 // Remainder
 //
 
-bool Remainder::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Remainder::apply(const Value &a, const Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->mod(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(std::fmod(na, nb));
+}
+
+bool Remainder::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Remainder::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::MOD, r, x, x + 1);
+}
+
 bool Remainder::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1693,6 +1885,12 @@ bool LogicalNot::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LogicalNot::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc();
+  m_x->compile(b, x);
+  b.emit(Bytecode::Op::NOT, r, x);
+}
+
 bool LogicalNot::declare(Module *module, Scope &scope, Error &error) {
   return m_x->declare(module, scope, error);
 }
@@ -1717,6 +1915,13 @@ bool LogicalAnd::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LogicalAnd::compile(Bytecode::Builder &b, int r) {
+  m_a->compile(b, r);
+  auto j = b.emit(Bytecode::Op::JMP_FALSE, 0, r);
+  m_b->compile(b, r);
+  b.patch(j);
+}
+
 bool LogicalAnd::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1745,6 +1950,13 @@ bool LogicalOr::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LogicalOr::compile(Bytecode::Builder &b, int r) {
+  m_a->compile(b, r);
+  auto j = b.emit(Bytecode::Op::JMP_TRUE, 0, r);
+  m_b->compile(b, r);
+  b.patch(j);
+}
+
 bool LogicalOr::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1773,6 +1985,13 @@ bool NullishCoalescing::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void NullishCoalescing::compile(Bytecode::Builder &b, int r) {
+  m_a->compile(b, r);
+  auto j = b.emit(Bytecode::Op::JMP_SOME, 0, r);
+  m_b->compile(b, r);
+  b.patch(j);
+}
+
 bool NullishCoalescing::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1794,22 +2013,33 @@ void NullishCoalescing::dump(std::ostream &out, const std::string &indent) {
 // Equality
 //
 
-bool Equality::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Equality::apply(const Value &a, const Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->eql(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   result.set(Value::is_equal(a, b));
+}
+
+bool Equality::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Equality::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::EQ, r, x, x + 1);
+}
+
 bool Equality::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1831,22 +2061,33 @@ void Equality::dump(std::ostream &out, const std::string &indent) {
 // Inequality
 //
 
-bool Inequality::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void Inequality::apply(const Value &a, const Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(!ia->eql(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   result.set(!Value::is_equal(a, b));
+}
+
+bool Inequality::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void Inequality::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::NE, r, x, x + 1);
+}
+
 bool Inequality::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1876,6 +2117,13 @@ bool Identity::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Identity::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::SEQ, r, x, x + 1);
+}
+
 bool Identity::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1905,6 +2153,13 @@ bool Nonidentity::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Nonidentity::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::SNE, r, x, x + 1);
+}
+
 bool Nonidentity::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1926,10 +2181,7 @@ void Nonidentity::dump(std::ostream &out, const std::string &indent) {
 // GreaterThan
 //
 
-bool GreaterThan::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void GreaterThan::apply(const Value &a, const Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -1945,9 +2197,23 @@ bool GreaterThan::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na > nb);
   }
+}
+
+bool GreaterThan::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void GreaterThan::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::GT, r, x, x + 1);
+}
+
 bool GreaterThan::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1969,10 +2235,7 @@ void GreaterThan::dump(std::ostream &out, const std::string &indent) {
 // GreaterThanOrEqual
 //
 
-bool GreaterThanOrEqual::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void GreaterThanOrEqual::apply(const Value &a, const Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -1988,9 +2251,23 @@ bool GreaterThanOrEqual::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na >= nb);
   }
+}
+
+bool GreaterThanOrEqual::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void GreaterThanOrEqual::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::GE, r, x, x + 1);
+}
+
 bool GreaterThanOrEqual::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -2012,10 +2289,7 @@ void GreaterThanOrEqual::dump(std::ostream &out, const std::string &indent) {
 // LessThan
 //
 
-bool LessThan::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void LessThan::apply(const Value &a, const Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -2031,9 +2305,23 @@ bool LessThan::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na < nb);
   }
+}
+
+bool LessThan::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void LessThan::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::LT, r, x, x + 1);
+}
+
 bool LessThan::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -2055,10 +2343,7 @@ void LessThan::dump(std::ostream &out, const std::string &indent) {
 // LessThanOrEqual
 //
 
-bool LessThanOrEqual::eval(Context &ctx, Value &result) {
-  Value a, b;
-  if (!m_a->eval(ctx, a)) return false;
-  if (!m_b->eval(ctx, b)) return false;
+void LessThanOrEqual::apply(const Value &a, const Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -2074,9 +2359,23 @@ bool LessThanOrEqual::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na <= nb);
   }
+}
+
+bool LessThanOrEqual::eval(Context &ctx, Value &result) {
+  Value a, b;
+  if (!m_a->eval(ctx, a)) return false;
+  if (!m_b->eval(ctx, b)) return false;
+  apply(a, b, result);
   return true;
 }
 
+void LessThanOrEqual::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc(2);
+  m_a->compile(b, x);
+  m_b->compile(b, x + 1);
+  b.emit(Bytecode::Op::LE, r, x, x + 1);
+}
+
 bool LessThanOrEqual::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -2929,6 +3228,17 @@ bool Conditional::eval(Context &ctx, Value &result) {
   }
 }
 
+void Conditional::compile(Bytecode::Builder &b, int r) {
+  auto x = b.alloc();
+  m_a->compile(b, x);
+  auto j1 = b.emit(Bytecode::Op::JMP_FALSE, 0, x);
+  m_b->compile(b, r);
+  auto j2 = b.emit(Bytecode::Op::JMP);
+  b.patch(j1);
+  m_c->compile(b, r);
+  b.patch(j2);
+}
+
 bool Conditional::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -29,6 +29,7 @@
 #include "types.hpp"
 #include "tree.hpp"
 #include "builtin.hpp"
+#include "bytecode.hpp"
 
 #include <cmath>
 #include <string>
@@ -163,6 +164,7 @@ public:
   virtual bool clear(Context &ctx, Value &result) { return error(ctx, "cannot delete a value"); }
   virtual auto reduce(Reducer &r) -> Reducer::Value* { return r.undefined(); }
   virtual auto reduce_lval(Reducer &r, Reducer::Value *rval) -> Reducer::Value* { return r.undefined(); }
+  virtual void compile(Bytecode::Builder &b, int r) { b.eval(this, r); }
   virtual void dump(std::ostream &out, const std::string &indent = "") = 0;
 
 protected:
@@ -219,6 +221,7 @@ public:
   virtual bool is_argument_list() const override;
   virtual bool is_comma_ended() const override { return m_is_comma_ended; }
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
@@ -238,7 +241,10 @@ public:
   Concatenation(std::list<std::unique_ptr<Expr>> &&exprs)
     : m_exprs(std::move(exprs)) {}
 
+  static void apply(const Value *v, int n, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -254,6 +260,7 @@ private:
 class Undefined : public Expr {
 public:
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 };
@@ -265,6 +272,7 @@ public:
 class Null : public Expr {
 public:
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 };
@@ -278,6 +286,7 @@ public:
   BooleanLiteral(bool b) : m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
@@ -294,6 +303,7 @@ public:
   NumberLiteral(double n) : m_n(n) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
@@ -312,6 +322,7 @@ public:
   auto s() const -> Str* { return m_s; }
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
@@ -406,6 +417,7 @@ public:
 private:
   std::vector<std::unique_ptr<Expr>> m_inputs;
   std::unique_ptr<Stmt> m_output;
+  std::unique_ptr<Bytecode> m_code;
   Scope m_scope;
   Ref<Method> m_method;
 };
@@ -498,6 +510,7 @@ public:
 
   virtual bool is_left_value() const override;
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -542,6 +555,7 @@ public:
   virtual void unpack(std::vector<Ref<Str>> &vars) const override;
   virtual bool unpack(Context &ctx, Value &arg, int &var) override;
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
@@ -571,8 +585,12 @@ class Property : public Expr {
 public:
   Property(Expr *obj, Expr *key) : m_obj(obj), m_key(key) {}
 
+  bool get(Context &ctx, const Value &obj, const Value &key, Value &result);
+  bool get(Context &ctx, const Value &obj, Str *key, Value &result);
+
   virtual bool is_left_value() const override;
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
@@ -632,7 +650,11 @@ class Invocation : public Expr {
 public:
   Invocation(Expr *func, std::vector<std::unique_ptr<Expr>> &&argv) : m_func(func), m_argv(std::move(argv)) {}
 
+  bool callable(Context &ctx, const Value &f);
+  bool call(Context &ctx, Value &f, int argc, Value *argv, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
@@ -687,7 +709,10 @@ class Negation : public Expr {
 public:
   Negation(Expr *x) : m_x(x) {}
 
+  static void apply(const Value &x, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -704,7 +729,10 @@ class Addition : public Expr {
 public:
   Addition(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -722,7 +750,10 @@ class Subtraction : public Expr {
 public:
   Subtraction(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -740,7 +771,10 @@ class Multiplication : public Expr {
 public:
   Multiplication(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -758,7 +792,10 @@ class Division : public Expr {
 public:
   Division(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -776,7 +813,10 @@ class Remainder : public Expr {
 public:
   Remainder(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -938,6 +978,7 @@ public:
   LogicalNot(Expr *x) : m_x(x) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -955,6 +996,7 @@ public:
   LogicalAnd(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -973,6 +1015,7 @@ public:
   LogicalOr(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -991,6 +1034,7 @@ public:
   NullishCoalescing(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1008,7 +1052,10 @@ class Equality : public Expr {
 public:
   Equality(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1026,7 +1073,10 @@ class Inequality : public Expr {
 public:
   Inequality(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1045,6 +1095,7 @@ public:
   Identity(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1063,6 +1114,7 @@ public:
   Nonidentity(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1080,7 +1132,10 @@ class GreaterThan : public Expr {
 public:
   GreaterThan(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1098,7 +1153,10 @@ class GreaterThanOrEqual : public Expr {
 public:
   GreaterThanOrEqual(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1116,7 +1174,10 @@ class LessThan : public Expr {
 public:
   LessThan(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1134,7 +1195,10 @@ class LessThanOrEqual : public Expr {
 public:
   LessThanOrEqual(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
+  static void apply(const Value &a, const Value &b, Value &result);
+
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1596,6 +1660,7 @@ public:
   Conditional(Expr *a, Expr *b, Expr *c) : m_a(a), m_b(b), m_c(c) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode::Builder &b, int r) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
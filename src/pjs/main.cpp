@@ -25,8 +25,19 @@
 
 #include "pjs.hpp"
 
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
+#if defined(__linux__) && defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+#define PJS_BENCH_MEMORY
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#endif
+
 using namespace pjs;
 
 class Console;
@@ -40,6 +51,7 @@ class TestGlobal : public ObjectTemplate<TestGlobal, Global> {};
 template<> void ClassDef<TestGlobal>::init() {
   ctor();
   variable("console", class_of<Console>());
+  variable("Object", class_of<Constructor<Object>>());
 }
 
 //
@@ -133,14 +145,156 @@ static void test_eval(Context &ctx, const char *script) {
   std::cout << "Result: " << result.to_string()->str() << std::endl;
 }
 
+//
+// Micro-benchmarks
+//
+// Each script evaluates to a function that is then called repeatedly,
+// once with the tree walker and once with the bytecode interpreter.
+//
+
+static void bench(Context &ctx, const char *name, const char *script, int count = 200000) {
+  std::string error;
+  int error_line, error_column;
+  Module module(ctx.instance());
+  module.load("bench", script);
+  if (!module.compile(error, error_line, error_column)) {
+    std::cerr << name << ": syntax error at line " << error_line << " column " << error_column << ": " << error << std::endl;
+    return;
+  }
+
+  Value f;
+  module.execute(ctx, -1, nullptr, f);
+  if (!ctx.ok()) {
+    std::cerr << name << ": " << ctx.error().message << std::endl;
+    ctx.reset();
+    return;
+  }
+  if (!f.is_function()) {
+    std::cerr << name << ": script does not evaluate to a function" << std::endl;
+    return;
+  }
+
+  // Alternate the two modes over a few rounds and keep the best
+  // round of each so that noise hits both sides alike
+  double ns[2] = { 0, 0 };
+  std::string results[2];
+  for (int round = 0; round < 5; round++) {
+    for (int mode = 0; mode < 2; mode++) {
+      Bytecode::enable(mode == 1);
+      Value ret;
+      auto t = std::chrono::steady_clock::now();
+      for (int i = 0; i < count; i++) {
+        (*f.as<Function>())(ctx, 0, nullptr, ret);
+        if (!ctx.ok()) {
+          std::cerr << name << ": " << ctx.error().message << std::endl;
+          ctx.reset();
+          Bytecode::enable(false);
+          return;
+        }
+      }
+      auto d = std::chrono::steady_clock::now() - t;
+      auto n = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / double(count);
+      if (!round || n < ns[mode]) ns[mode] = n;
+      auto s = ret.to_string();
+      results[mode] = s->str();
+      s->release();
+    }
+  }
+  Bytecode::enable(false);
+
+  char line[200];
+  std::snprintf(
+    line, sizeof(line), "%-20s %10.1f ns %10.1f ns %8.2fx%s",
+    name, ns[0], ns[1], ns[0] / ns[1],
+    results[0] == results[1] ? "" : "  MISMATCH"
+  );
+  std::cout << line << std::endl;
+}
+
+//
+// Memory benchmarks
+//
+// Each script evaluates to a function returning a new object, which is
+// called repeatedly while keeping all the objects alive. Measurements
+// run in a forked child so that every case starts off the same pools.
+//
+
+static void bench_memory(Context &ctx, const char *name, const char *script, int count = 10000) {
+#ifdef PJS_BENCH_MEMORY
+  std::string error;
+  int error_line, error_column;
+  Module module(ctx.instance());
+  module.load("bench", script);
+  if (!module.compile(error, error_line, error_column)) {
+    std::cerr << name << ": syntax error at line " << error_line << " column " << error_column << ": " << error << std::endl;
+    return;
+  }
+
+  Value f;
+  module.execute(ctx, -1, nullptr, f);
+  if (!ctx.ok()) {
+    std::cerr << name << ": " << ctx.error().message << std::endl;
+    ctx.reset();
+    return;
+  }
+  if (!f.is_function()) {
+    std::cerr << name << ": script does not evaluate to a function" << std::endl;
+    return;
+  }
+
+  std::cout.flush();
+  auto pid = fork();
+  if (pid == 0) {
+    std::vector<Value> objects(count);
+    auto before = mallinfo2().uordblks;
+    for (int i = 0; i < count; i++) {
+      (*f.as<Function>())(ctx, 0, nullptr, objects[i]);
+    }
+    auto after = mallinfo2().uordblks;
+    char line[200];
+    std::snprintf(line, sizeof(line), "%-20s %10.1f bytes/object", name, double(after - before) / count);
+    std::cout << line << std::endl;
+    _exit(0);
+  }
+  waitpid(pid, nullptr, 0);
+#endif // PJS_BENCH_MEMORY
+}
+
+static void bench_all(Context &ctx) {
+  std::cout << "benchmark                  tree   bytecode  speedup" << std::endl;
+  bench(ctx, "property-access", "(o => () => o.a.b + o.a.c * o.d - o.a.b)({ a: { b: 1, c: 2 }, d: 3 })");
+  bench(ctx, "string-concat", "((s, n) => () => s + '/' + n + '/' + s)('hello', 42)");
+  bench(ctx, "template-string", "((s, n) => () => `${s}:${n}:${s.length}`)('hello', 42)");
+  bench(ctx, "conditional", "(o => () => o.x > o.y ? o.x - o.y : (o.z ?? 0) || o.y)({ x: 1, y: 2 })");
+  bench(ctx, "closure-call", "(k => (f => () => f(1) + f(2) + f(3))(x => x * k + 1))(3)");
+  bench(ctx, "array-reduce", "(a => () => a.reduce((s, x) => s + x * 2, 0))([1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16])", 20000);
+  bench(ctx, "dynamic-props-shape", "(o => () => o.host + o.path + o.accept)(Object.assign({}, { method: 'GET', path: '/api', host: 'example.com', accept: '*/*' }))");
+  bench(ctx, "dynamic-props-hash", "(o => () => o.host + o.path + o.accept)((o => (o._ = 0, delete o._, o))(Object.assign({}, { method: 'GET', path: '/api', host: 'example.com', accept: '*/*' })))");
+  bench(ctx, "array-map-filter", "(a => () => a.map(x => x + 1).filter(x => x % 2 === 0).length)([1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16])", 20000);
+
+#ifdef PJS_BENCH_MEMORY
+  std::cout << std::endl;
+  std::cout << "memory" << std::endl;
+  bench_memory(ctx, "6-props-shape", "(src => () => Object.assign({}, src))({ method: 'GET', path: '/api/v1/users', host: 'example.com', 'user-agent': 'curl', accept: '*/*', 'x-request-id': 'abc' })");
+  bench_memory(ctx, "6-props-hash", "(src => () => (o => (o._ = 0, delete o._, o))(Object.assign({}, src)))({ method: 'GET', path: '/api/v1/users', host: 'example.com', 'user-agent': 'curl', accept: '*/*', 'x-request-id': 'abc' })");
+  bench_memory(ctx, "20-props-shape", "(src => () => Object.assign({}, src))({ a0: 0, a1: 1, a2: 2, a3: 3, a4: 4, a5: 5, a6: 6, a7: 7, a8: 8, a9: 9, b0: 0, b1: 1, b2: 2, b3: 3, b4: 4, b5: 5, b6: 6, b7: 7, b8: 8, b9: 9 })");
+  bench_memory(ctx, "20-props-hash", "(src => () => (o => (o._ = 0, delete o._, o))(Object.assign({}, src)))({ a0: 0, a1: 1, a2: 2, a3: 3, a4: 4, a5: 5, a6: 6, a7: 7, a8: 8, a9: 9, b0: 0, b1: 1, b2: 2, b3: 3, b4: 4, b5: 5, b6: 6, b7: 7, b8: 8, b9: 9 })");
+#endif
+}
+
 //
 // main
 //
 
-int main() {
+int main(int argc, char *argv[]) {
   Instance instance(TestGlobal::make());
   Context ctx(&instance);
 
+  if (argc > 1 && !std::strcmp(argv[1], "bench")) {
+    bench_all(ctx);
+    return 0;
+  }
+
   test_tokenizer("undefined/null/true/false void new delete deleted intypeof in typeof instanceoff.instanceof ");
   test_tokenizer("(0+1)-[2]*{3}/4%5**6&7|8^9~a!b?c:d&&你||好??世界");
   test_tokenizer("+++++-----*****======>>>>>!!000\"\"??.....26?.()?.[]xyz");
@@ -98,6 +98,8 @@ public:
   Block() {}
   Block(std::list<std::unique_ptr<Stmt>> &&stmts) : m_stmts(std::move(stmts)) {}
 
+  auto stmts() const -> const std::list<std::unique_ptr<Stmt>>& { return m_stmts; }
+
   virtual bool is_expression() const override;
   virtual bool declare(Module *module, Tree::Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, Tree::LegacyImports *imports) override;
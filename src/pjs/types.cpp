@@ -744,6 +744,47 @@ void Class::assign(Object *obj, Object *src) {
   }
 }
 
+//
+// Shape
+//
+
+thread_local int Shape::s_count = 0;
+
+auto Shape::root() -> Shape* {
+  thread_local static Shape s_root;
+  return &s_root;
+}
+
+Shape::Shape(Shape *parent, Str *key)
+  : m_keys(parent->m_keys)
+{
+  m_keys.push_back(key);
+  if (m_keys.size() > MAX_LINEAR_SEARCH) {
+    for (int i = 0, n = m_keys.size(); i < n; i++) {
+      m_map[m_keys[i]] = i;
+    }
+  }
+  s_count++;
+}
+
+Shape::~Shape() {
+  for (const auto &p : m_transitions) {
+    delete p.second;
+  }
+  if (!m_keys.empty()) s_count--;
+}
+
+auto Shape::add(Str *key) -> Shape* {
+  auto i = m_transitions.find(key);
+  if (i != m_transitions.end()) return i->second;
+  if (m_keys.size() >= MAX_SIZE) return nullptr;
+  if (m_transitions.size() >= MAX_TRANSITIONS) return nullptr;
+  if (s_count >= MAX_SHAPES) return nullptr;
+  auto *shape = new Shape(this, key);
+  m_transitions[key] = shape;
+  return shape;
+}
+
 //
 // Object
 //
@@ -800,6 +841,50 @@ template<> void ClassDef<Constructor<Object>>::init() {
   });
 }
 
+void Object::ht_add(Shape *shape, const Value &val) {
+  auto base = m_class->variable_count();
+  auto i = shape->size() - 1;
+  if (base + i >= m_data->size()) {
+    auto capacity = std::min(std::max(4, i * 2), int(Shape::MAX_SIZE));
+    auto data = Data::make(base + capacity);
+    for (size_t j = 0, n = m_data->size(); j < n; j++) {
+      data->at(j) = m_data->at(j);
+    }
+    m_data->free();
+    m_data = data;
+  }
+  m_data->at(base + i) = val;
+  m_shape = shape;
+}
+
+void Object::ht_convert() {
+  auto *h = OrderedHash<Ref<Str>, Value>::make();
+  if (auto shape = m_shape) {
+    auto base = m_class->variable_count();
+    for (int i = 0, n = shape->size(); i < n; i++) {
+      auto &v = m_data->at(base + i);
+      h->set(shape->key(i), v);
+      v = Value::undefined;
+    }
+    m_shape = nullptr;
+  }
+  m_hash = h;
+}
+
+bool Object::ht_iterate(Shape *shape, const std::function<bool(Str*, Value&)> &callback) {
+  auto base = m_class->variable_count();
+  for (int i = 0, n = shape->size(); i < n; i++) {
+
+    // Hand out a copy since the callback could add properties
+    // and have the slots moved, writing it back if it was changed
+    Value v(m_data->at(base + i)), old(v);
+    if (!callback(shape->key(i), v)) return false;
+    if (!m_shape) break;
+    if (!Value::is_identical(v, old)) m_data->at(base + i) = v;
+  }
+  return true;
+}
+
 void Object::value_of(Value &out) {
   out.set(this);
 }
@@ -512,34 +512,40 @@ public:
     Pool(size_t alloc_size)
       : m_alloc_size(alloc_size) {}
 
-    auto alloc() -> PooledArrayBase* {
+    auto alloc() -> void* {
       if (auto p = m_free) {
-        m_free = p->m_next;
+        m_free = p->next;
         return p;
       } else {
-        p = (PooledArrayBase*)std::malloc(m_alloc_size);
-        p->m_pool = this;
-        return p;
+        return std::malloc(m_alloc_size);
       }
     }
 
-    void free(PooledArrayBase *p) {
-      p->m_next = m_free;
-      m_free = p;
+    void free(void *p) {
+      auto f = static_cast<Free*>(p);
+      f->next = m_free;
+      m_free = f;
     }
 
   private:
+    struct Free { Free* next; };
+
     size_t m_alloc_size;
-    PooledArrayBase* m_free = nullptr;
+    Free* m_free = nullptr;
   };
 
   void recycle() {
     m_pool->free(this);
   }
 
+protected:
+
+  // The pool is set by the constructor rather than by alloc(), since
+  // stores made before placement new can be dropped by the optimizer
+  PooledArrayBase(Pool *pool) : m_pool(pool) {}
+
 private:
   Pool* m_pool;
-  PooledArrayBase* m_next;
 };
 
 //
@@ -550,15 +556,13 @@ template<class T>
 class PooledArray : public PooledArrayBase {
 public:
   static auto make(size_t size) -> PooledArray* {
-    auto p = alloc(size);
-    new (p) PooledArray(size);
-    return p;
+    auto pool = pool_of(size);
+    return new (pool->alloc()) PooledArray(pool, size);
   }
 
   static auto make(size_t size, const T &initial) -> PooledArray* {
-    auto p = alloc(size);
-    new (p) PooledArray(size, initial);
-    return p;
+    auto pool = pool_of(size);
+    return new (pool->alloc()) PooledArray(pool, size, initial);
   }
 
   void free() {
@@ -586,13 +590,13 @@ private:
   size_t m_size;
   T m_elements[0];
 
-  PooledArray(size_t size) : m_size(size) {
+  PooledArray(Pool *pool, size_t size) : PooledArrayBase(pool), m_size(size) {
     for (size_t i = 0; i < size; i++) {
       new (m_elements + i) T();
     }
   }
 
-  PooledArray(size_t size, const T &initial) : m_size(size) {
+  PooledArray(Pool *pool, size_t size, const T &initial) : PooledArrayBase(pool), m_size(size) {
     for (size_t i = 0; i < size; i++) {
       new (m_elements + i) T(initial);
     }
@@ -604,13 +608,13 @@ private:
     }
   }
 
-  static auto alloc(size_t size) -> PooledArray* {
+  static auto pool_of(size_t size) -> Pool* {
     auto &pools = m_pools;
     auto slot = slot_of_size(size);
     for (auto i = pools.size(); i <= slot; i++) {
       pools.emplace_back(new Pool(sizeof(PooledArray) + sizeof(T) * size_of_slot(i)));
     }
-    return static_cast<PooledArray*>(pools[slot]->alloc());
+    return pools[slot].get();
   }
 
   static auto slot_of_size(size_t size) -> size_t {
@@ -1086,6 +1090,7 @@ public:
   bool has_geti() const { return (bool)m_geti; }
   bool has_seti() const { return (bool)m_seti; }
   auto object_count() const -> size_t { return m_object_count; }
+  auto variable_count() const -> size_t { return m_variables.size(); }
 
   auto field_count() const -> size_t {
     return m_fields.size();
@@ -1737,6 +1742,58 @@ namespace pjs {
 
 typedef PooledArray<Value> Data;
 
+//
+// Shape
+//
+// Layout of the properties added to an object outside of its class.
+// Objects that get the same keys in the same order share one shape,
+// and keep the values in slots after their class variables, so that
+// a lookup cached against a shape is a plain array read.
+//
+// Shapes live as long as their thread. The tree is kept bounded by
+// limiting the slots per shape, the transitions out of each shape and
+// the total number of shapes. Objects running past any of the limits,
+// or having a property deleted, fall back to an OrderedHash.
+//
+
+class Shape {
+public:
+  static const int MAX_SIZE = 64;
+
+  static auto root() -> Shape*;
+
+  auto size() const -> int { return m_keys.size(); }
+  auto key(int i) const -> Str* { return m_keys[i]; }
+
+  auto find(Str *key) const -> int {
+    if (m_map.empty()) {
+      for (int i = 0, n = m_keys.size(); i < n; i++) {
+        if (m_keys[i] == key) return i;
+      }
+      return -1;
+    }
+    auto i = m_map.find(key);
+    return i == m_map.end() ? -1 : i->second;
+  }
+
+  auto add(Str *key) -> Shape*;
+
+private:
+  static const int MAX_TRANSITIONS = 32;
+  static const int MAX_SHAPES = 4096;
+  static const int MAX_LINEAR_SEARCH = 8;
+
+  Shape() {}
+  Shape(Shape *parent, Str *key);
+  ~Shape();
+
+  std::vector<Ref<Str>> m_keys;
+  std::unordered_map<Str*, int> m_map;
+  std::unordered_map<Str*, Shape*> m_transitions;
+
+  thread_local static int s_count;
+};
+
 //
 // Object
 //
@@ -1757,6 +1814,8 @@ public:
 
   auto type() const -> Class* { return m_class; }
   auto data() const -> Data* { return m_data; }
+  auto shape() const -> Shape* { return m_shape; }
+  auto slot(int i) const -> Value&;
   auto location() const -> const Location& { return m_location; }
 
   template<class T> auto as() -> T* { return static_cast<T*>(this); }
@@ -1771,8 +1830,8 @@ public:
   bool has(Str *key);
   bool get(Str *key, Value &val);
   void set(Str *key, const Value &val);
-  auto ht_size() const -> size_t { return m_hash ? m_hash->size() : 0; }
-  bool ht_has(Str *key) { return m_hash ? m_hash->has(key) : false; }
+  auto ht_size() const -> size_t { return m_hash ? m_hash->size() : (m_shape ? m_shape->size() : 0); }
+  bool ht_has(Str *key) { return m_hash ? m_hash->has(key) : (m_shape && m_shape->find(key) >= 0); }
   bool ht_get(Str *key, Value &val);
   void ht_set(Str *key, const Value &val);
   bool ht_delete(Str *key);
@@ -1842,8 +1901,13 @@ protected:
   virtual void finalize() { delete this; }
 
 private:
+  void ht_add(Shape *shape, const Value &val);
+  void ht_convert();
+  bool ht_iterate(Shape *shape, const std::function<bool(Str*, Value&)> &callback);
+
   Class* m_class = nullptr;
   Data* m_data = nullptr;
+  Shape* m_shape = nullptr;
   Ref<OrderedHash<Ref<Str>, Value>> m_hash;
   Location m_location;
   Object* m_class_prev = nullptr;
@@ -2005,6 +2069,9 @@ void ClassDef<T>::variable(const std::string &name, Class *clazz, int options) {
 
 inline auto Class::init(Object *obj, Object *prototype) -> Object* {
   auto size = m_variables.size();
+  if (prototype && prototype->type() == this && prototype->m_shape) {
+    size = prototype->m_data->size();
+  }
   auto data = Data::make(size);
   if (!prototype) {
     for (size_t i = 0; i < size; i++) {
@@ -2015,19 +2082,22 @@ inline auto Class::init(Object *obj, Object *prototype) -> Object* {
     for (size_t i = 0; i < size; i++) {
       data->at(i) = prototype->data()->at(i);
     }
+    obj->m_shape = prototype->m_shape;
     obj->m_hash = prototype->m_hash;
   } else {
     for (size_t i = 0; i < size; i++) {
       auto v = m_variables[i];
       data->at(i) = v->value();
     }
-    Object::assign(obj, prototype);
   }
   obj->m_class = this;
   obj->m_data = data;
   retain();
   trace(obj);
   m_object_count++;
+  if (prototype && prototype->type() != this) {
+    Object::assign(obj, prototype);
+  }
   return obj;
 }
 
@@ -2050,23 +2120,50 @@ inline bool Object::has(Str *key) {
   else return ht_has(key);
 }
 
+inline auto Object::slot(int i) const -> Value& {
+  return m_data->at(m_class->variable_count() + i);
+}
+
 inline bool Object::ht_get(Str *key, Value &val) {
   assert_same_thread(*this);
-  if (!m_hash || !m_hash->get(key, val)) {
-    val = Value::undefined;
-    return false;
+  if (m_shape) {
+    auto i = m_shape->find(key);
+    if (i >= 0) {
+      val = slot(i);
+      return true;
+    }
+  } else if (m_hash && m_hash->get(key, val)) {
+    return true;
   }
-  return true;
+  val = Value::undefined;
+  return false;
 }
 
 inline void Object::ht_set(Str *key, const Value &val) {
   assert_same_thread(*this);
-  if (!m_hash) m_hash = OrderedHash<Ref<Str>, Value>::make();
+  if (!m_hash) {
+    if (m_shape) {
+      auto i = m_shape->find(key);
+      if (i >= 0) {
+        slot(i) = val;
+        return;
+      }
+    }
+    if (auto shape = (m_shape ? m_shape : Shape::root())->add(key)) {
+      ht_add(shape, val);
+      return;
+    }
+    ht_convert();
+  }
   m_hash->set(key, val);
 }
 
 inline bool Object::ht_delete(Str *key) {
   assert_same_thread(*this);
+  if (m_shape) {
+    if (m_shape->find(key) < 0) return false;
+    ht_convert();
+  }
   if (!m_hash) return false;
   return m_hash->erase(key);
 }
@@ -2084,7 +2181,9 @@ inline void Object::iterate_all(const std::function<void(Str*, Value&)> &callbac
       callback(f->name(), m_data->at(static_cast<Variable*>(f)->index()));
     }
   }
-  if (m_hash) {
+  if (m_shape) {
+    ht_iterate(m_shape, [&](Str *k, Value &v) { callback(k, v); return true; });
+  } else if (m_hash) {
     OrderedHash<Ref<Str>, Value>::Iterator iterator(m_hash);
     while (auto *ent = iterator.next()) {
       callback(ent->k, ent->v);
@@ -2110,7 +2209,9 @@ inline bool Object::iterate_while(const std::function<bool(Str*, Value&)> &callb
 
 inline bool Object::iterate_hash(const std::function<bool(Str*, Value&)> &callback) {
   assert_same_thread(*this);
-  if (m_hash) {
+  if (m_shape) {
+    return ht_iterate(m_shape, callback);
+  } else if (m_hash) {
     OrderedHash<Ref<Str>, Value>::Iterator iterator(m_hash);
     while (auto *ent = iterator.next()) {
       if (!callback(ent->k, ent->v)) {
@@ -3272,7 +3373,8 @@ public:
   bool has(Object *obj, Str *key) {
     auto i = find(obj->type(), key);
     if (i >= 0) return true;
-    else return obj->ht_has(key);
+    if (auto shape = obj->shape()) return find_slot(shape, key) >= 0;
+    return obj->ht_has(key);
   }
 
   bool del(Object *obj, Str *key) {
@@ -3299,6 +3401,11 @@ public:
       val = obj->data()->at(static_cast<Variable*>(f)->index());
       return;
     }
+    if (auto shape = obj->shape()) {
+      auto j = find_slot(shape, key);
+      if (j >= 0) val = obj->slot(j); else val = Value::undefined;
+      return;
+    }
     obj->ht_get(key, val);
   }
 
@@ -3316,6 +3423,13 @@ public:
         return;
       }
     }
+    if (auto shape = obj->shape()) {
+      auto j = find_slot(shape, key);
+      if (j >= 0) {
+        obj->slot(j) = val;
+        return;
+      }
+    }
     obj->ht_set(key, val);
   }
 
@@ -3324,16 +3438,28 @@ private:
   Ref<Str> m_key;
   Ref<Class> m_class;
   int m_index = -1;
+  Shape* m_shape = nullptr;
+  int m_slot = -1;
 
   int find(Class *type, Str *key) {
     auto i = m_index;
     if (type != m_class || key != m_key) {
+      if (key != m_key) m_shape = nullptr;
       m_class = type;
       m_key = key;
       m_index = (i = type->find_field(key));
     }
     return i;
   }
+
+  // Only called right after find() with the same key
+  int find_slot(Shape *shape, Str *key) {
+    if (shape != m_shape) {
+      m_shape = shape;
+      m_slot = shape->find(key);
+    }
+    return m_slot;
+  }
 };
 
 //
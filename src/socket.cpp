@@ -28,6 +28,11 @@
 
 #include <errno.h>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif // __linux__
+
 namespace pipy {
 
 using tcp = asio::ip::tcp;
@@ -83,14 +88,71 @@ void SocketBase::log_error(const char *msg) {
 
 Data::Producer SocketTCP::s_dp("TCP Socket");
 
+thread_local size_t SocketTCP::s_pinned_size = 0;
+
+#ifndef _WIN32
+
+//
+// SocketTCP::ReceiveBuffer
+//
+
+class SocketTCP::ReceiveBuffer {
+public:
+  ~ReceiveBuffer() { delete m_block; }
+
+  //
+  // Reads whatever is available into the free room of the current
+  // chunk, so one chunk is shared by consecutive reads of different
+  // sockets. Returns true if the room was filled up, in which case
+  // more data could still be waiting in the socket.
+  //
+
+  bool read(tcp::socket &socket, Data &data, std::error_code &ec) {
+    if (!m_block || m_block->size() - m_offset < MIN_ROOM) {
+      delete m_block;
+      m_block = new Data::Block(&s_dp);
+      m_offset = 0;
+    }
+    auto room = m_block->size() - m_offset;
+    auto n = (int)socket.read_some(asio::buffer(m_block->ptr() + m_offset, room), ec);
+    if (n > 0) {
+      m_block->to_data(data, m_offset, n);
+      m_offset += n;
+    }
+    return n == room;
+  }
+
+private:
+  static const int MIN_ROOM = RECEIVE_BUFFER_SIZE / 4;
+
+  Data::Block* m_block = nullptr;
+  int m_offset = 0;
+};
+
+thread_local SocketTCP::ReceiveBuffer SocketTCP::s_receive_buffer;
+
+#endif // !_WIN32
+
 SocketTCP::~SocketTCP() {
   Ticker::get()->unwatch(this);
+  pin(false);
+#ifdef __linux__
+  unsplice();
+#endif
 }
 
 void SocketTCP::open() {
   m_socket.set_option(asio::socket_base::keep_alive(m_options.keep_alive));
   m_socket.set_option(tcp::no_delay(m_options.no_delay));
 
+#ifndef _WIN32
+  m_socket.non_blocking(true);
+#endif
+
+#ifdef PIPY_USE_IO_URING
+  m_uring = Net::current().io_uring();
+#endif
+
   auto t = Ticker::get()->tick();
   m_tick_read = t;
   m_tick_write = t;
@@ -147,11 +209,37 @@ void SocketTCP::receive() {
   if (m_receiving) return;
   if (m_paused) return;
 
+#ifdef __linux__
+  if (can_splice()) {
+    m_socket.async_wait(tcp::socket::wait_read, SpliceReadHandler(this));
+    m_receiving = true;
+    return;
+  }
+#endif
+
+#ifdef PIPY_USE_IO_URING
+  if (m_uring) {
+    m_uring->receive(m_socket.native_handle(), &m_uring_receiver);
+    m_receiving = true;
+    pin(m_uring_receiver.pinned());
+    return;
+  }
+#endif
+
+#ifdef _WIN32
   m_buffer_receive.push(Data(RECEIVE_BUFFER_SIZE, &s_dp));
   m_socket.async_read_some(
     DataChunks(m_buffer_receive.chunks()),
     ReceiveHandler(this)
   );
+  pin(true);
+#else
+  if (m_readable) {
+    asio::post(m_socket.get_executor(), ReadyHandler(this));
+  } else {
+    m_socket.async_wait(tcp::socket::wait_read, ReadyHandler(this));
+  }
+#endif
 
   m_receiving = true;
 }
@@ -182,6 +270,14 @@ void SocketTCP::send() {
     std::cerr << m_buffer_send.size() << std::endl;
   }
 
+#ifdef PIPY_USE_IO_URING
+  if (m_uring) {
+    m_uring->send(m_socket.native_handle(), m_buffer_send, &m_uring_sender);
+    m_sending = true;
+    return;
+  }
+#endif
+
   m_socket.async_write_some(
     DataChunks(m_buffer_send.chunks()),
     SendHandler(this)
@@ -203,7 +299,16 @@ void SocketTCP::shutdown_socket() {
 }
 
 void SocketTCP::close_socket() {
+#ifdef __linux__
+  unsplice();
+#endif
   if (m_socket.is_open()) {
+#ifdef PIPY_USE_IO_URING
+    if (m_uring) {
+      if (m_receiving) m_uring->cancel(&m_uring_receiver);
+      if (m_sending) m_uring->cancel(&m_uring_sender);
+    }
+#endif
     std::error_code ec;
     m_socket.close(ec);
     if (ec) {
@@ -223,6 +328,17 @@ void SocketTCP::close_async() {
   if (m_opened) on_socket_close();
 }
 
+void SocketTCP::pin(bool pinned) {
+  if (pinned != m_pinned) {
+    m_pinned = pinned;
+    if (pinned) {
+      s_pinned_size += RECEIVE_BUFFER_SIZE;
+    } else {
+      s_pinned_size -= RECEIVE_BUFFER_SIZE;
+    }
+  }
+}
+
 void SocketTCP::on_tap_open() {
   m_paused = false;
   receive();
@@ -230,6 +346,11 @@ void SocketTCP::on_tap_open() {
 
 void SocketTCP::on_tap_close() {
   m_paused = true;
+#ifdef PIPY_USE_IO_URING
+  if (m_uring && m_receiving && m_uring_receiver.multishot()) {
+    m_uring->cancel(&m_uring_receiver);
+  }
+#endif
 }
 
 void SocketTCP::on_flush() {
@@ -267,14 +388,44 @@ void SocketTCP::on_tick(double tick) {
 }
 
 void SocketTCP::on_receive(const std::error_code &ec, std::size_t n) {
-  InputContext ic(this);
+  m_receiving = false;
+  pin(false);
+  m_buffer_receive.pop(m_buffer_receive.size() - n);
+  on_receive(ec);
+}
+
+#ifndef _WIN32
 
+void SocketTCP::on_ready(const std::error_code &ec) {
   m_receiving = false;
+  m_readable = false;
+
+  if (ec || m_state == CLOSED) {
+    on_receive(ec);
+    return;
+  }
+
+  std::error_code err;
+  m_readable = s_receive_buffer.read(m_socket, m_buffer_receive, err);
+  if (err == asio::error::would_block || err == asio::error::try_again) {
+    err.clear();
+  }
+
+  on_receive(err);
+}
+
+#endif // !_WIN32
+
+void SocketTCP::on_receive(const std::error_code &ec) {
+  InputContext ic(this);
+
   m_tick_read = Ticker::get()->tick();
 
-  if (ec != asio::error::operation_aborted && m_state != CLOSED) {
-    if (n > 0) {
-      m_buffer_receive.pop(m_buffer_receive.size() - n);
+  if (ec == asio::error::operation_aborted) {
+    if (m_state != CLOSED) receive();
+
+  } else if (m_state != CLOSED) {
+    if (!m_buffer_receive.empty()) {
       auto size = m_buffer_receive.size();
       m_traffic_read += size;
 
@@ -359,6 +510,154 @@ void SocketTCP::on_send(const std::error_code &ec, std::size_t n) {
   close_async();
 }
 
+void SocketTCP::splice(SocketTCP *peer) {
+#ifdef __linux__
+  if (peer == this || m_splice_peer || peer->m_splice_peer) return;
+  m_splice_peer = peer;
+  peer->m_splice_peer = this;
+#endif
+}
+
+#ifdef __linux__
+
+//
+// Splicing takes over from the next receive in either direction,
+// but only once everything the peer still has to send from the
+// normal path has gone out, so that bytes stay in order
+//
+
+bool SocketTCP::can_splice() {
+  auto peer = m_splice_peer;
+  if (!peer || !peer->m_opened) return false;
+#ifdef PIPY_USE_IO_URING
+  if (m_uring || peer->m_uring) return false;
+#endif
+  if (peer->m_state != OPEN && peer->m_state != HALF_CLOSED_REMOTE) return false;
+  if (peer->m_sending || peer->m_eos || !peer->m_buffer_send.empty()) return false;
+  if (m_splice_pipe[0] < 0) {
+    if (pipe2(m_splice_pipe, O_NONBLOCK | O_CLOEXEC)) {
+      m_splice_pipe[0] = m_splice_pipe[1] = -1;
+      return false;
+    }
+  }
+  return true;
+}
+
+void SocketTCP::unsplice() {
+  if (auto peer = m_splice_peer) {
+    peer->m_splice_peer = nullptr;
+    m_splice_peer = nullptr;
+    for (auto *s : { this, peer }) {
+      if (s->m_splice_pipe[0] >= 0) {
+        ::close(s->m_splice_pipe[0]);
+        ::close(s->m_splice_pipe[1]);
+        s->m_splice_pipe[0] = s->m_splice_pipe[1] = -1;
+      }
+      s->m_splice_pending = 0;
+    }
+  }
+}
+
+void SocketTCP::splice_flush() {
+  while (auto peer = m_splice_peer) {
+    if (!m_splice_pending) break;
+    auto n = ::splice(
+      m_splice_pipe[0], nullptr,
+      peer->m_socket.native_handle(), nullptr,
+      m_splice_pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+    );
+    if (n > 0) {
+      m_splice_pending -= n;
+      peer->m_traffic_write += n;
+      peer->m_tick_write = Ticker::get()->tick();
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      peer->m_socket.async_wait(tcp::socket::wait_write, SpliceWriteHandler(this));
+      return;
+    } else {
+      auto ec = std::error_code(n < 0 ? errno : EPIPE, asio::error::get_system_category());
+      peer->m_sending = true;
+      peer->on_send(ec, 0);
+    }
+  }
+
+  m_receiving = false;
+
+  if (m_splice_eof) {
+    m_splice_eof = false;
+    on_receive(asio::error::eof);
+  } else {
+    on_receive(std::error_code());
+  }
+}
+
+void SocketTCP::on_splice_read(const std::error_code &ec) {
+  if (ec || !can_splice()) {
+    m_receiving = false;
+    on_receive(ec);
+    return;
+  }
+
+  for (;;) {
+    auto n = ::splice(
+      m_socket.native_handle(), nullptr,
+      m_splice_pipe[1], nullptr,
+      SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+    );
+    if (n > 0) {
+      m_splice_pending += n;
+      m_traffic_read += n;
+      m_tick_read = Ticker::get()->tick();
+      splice_flush();
+    } else if (n == 0) {
+      m_splice_eof = true;
+      splice_flush();
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN) {
+      m_socket.async_wait(tcp::socket::wait_read, SpliceReadHandler(this));
+    } else {
+      m_receiving = false;
+      on_receive(std::error_code(errno, asio::error::get_system_category()));
+    }
+    break;
+  }
+}
+
+void SocketTCP::on_splice_write(const std::error_code &ec) {
+  splice_flush();
+}
+
+#endif // __linux__
+
+#ifdef PIPY_USE_IO_URING
+
+void SocketTCP::on_uring_receive(int result, Data &data, bool more) {
+  if (!more) {
+    m_receiving = false;
+    pin(false);
+  }
+  if (result > 0) {
+    m_buffer_receive.push(std::move(data));
+    on_receive(std::error_code());
+  } else if (result == 0) {
+    on_receive(asio::error::eof);
+  } else {
+    on_receive(std::error_code(-result, asio::error::get_system_category()));
+  }
+}
+
+void SocketTCP::on_uring_send(int result) {
+  if (result >= 0) {
+    on_send(std::error_code(), result);
+  } else {
+    on_send(std::error_code(-result, asio::error::get_system_category()), 0);
+  }
+}
+
+#endif // PIPY_USE_IO_URING
+
 //
 // SocketUDP
 //
@@ -28,6 +28,7 @@
 
 #include "pjs/pjs.hpp"
 #include "net.hpp"
+#include "uring.hpp"
 #include "input.hpp"
 #include "data.hpp"
 #include "buffer.hpp"
@@ -81,6 +82,15 @@ class SocketTCP :
   public FlushTarget,
   public Ticker::Watcher
 {
+public:
+
+  // Bytes held by receive buffers of sockets still waiting for data
+  static auto pinned_size() -> size_t { return s_pinned_size; }
+
+  // Relay bytes to and from the peer socket inside the kernel,
+  // for pipelines that pass the bytes through untouched
+  void splice(SocketTCP *peer);
+
 protected:
   SocketTCP(bool is_inbound, const Options &options)
     : SocketBase(is_inbound, options)
@@ -117,6 +127,7 @@ private:
   bool m_receiving = false;
   bool m_sending = false;
   bool m_paused = false;
+  bool m_pinned = false;
   bool m_closed = false;
 
   void receive();
@@ -124,6 +135,7 @@ private:
   void shutdown_socket();
   void close_socket();
   void close_async();
+  void pin(bool pinned);
 
   virtual void on_tap_open() override;
   virtual void on_tap_close() override;
@@ -131,6 +143,7 @@ private:
   virtual void on_tick(double tick) override;
 
   void on_receive(const std::error_code &ec, std::size_t n);
+  void on_receive(const std::error_code &ec);
   void on_send(const std::error_code &ec, std::size_t n);
 
   struct ReceiveHandler : public SelfHandler<SocketTCP> {
@@ -145,6 +158,90 @@ private:
     void operator()(const std::error_code &ec, std::size_t n) { self->on_send(ec, n); }
   };
 
+#ifndef _WIN32
+
+  //
+  // Wait for readability first and only then read into a buffer
+  // shared by all sockets on the thread, so that an idle socket
+  // holds no receive buffer of its own
+  //
+
+  class ReceiveBuffer;
+
+  bool m_readable = false;
+
+  void on_ready(const std::error_code &ec);
+
+  struct ReadyHandler : public SelfHandler<SocketTCP> {
+    using SelfHandler::SelfHandler;
+    ReadyHandler(const ReadyHandler &r) : SelfHandler(r) {}
+    void operator()() { self->on_ready(std::error_code()); }
+    void operator()(const std::error_code &ec) { self->on_ready(ec); }
+  };
+
+  thread_local static ReceiveBuffer s_receive_buffer;
+
+#endif // !_WIN32
+
+#ifdef __linux__
+
+  //
+  // While spliced, received bytes go into a pipe and then
+  // straight onto the peer socket, never entering user space
+  //
+
+  static const size_t SPLICE_SIZE = 0x10000;
+
+  SocketTCP* m_splice_peer = nullptr;
+  int m_splice_pipe[2] = { -1, -1 };
+  size_t m_splice_pending = 0;
+  bool m_splice_eof = false;
+
+  bool can_splice();
+  void unsplice();
+  void splice_flush();
+  void on_splice_read(const std::error_code &ec);
+  void on_splice_write(const std::error_code &ec);
+
+  struct SpliceReadHandler : public SelfHandler<SocketTCP> {
+    using SelfHandler::SelfHandler;
+    SpliceReadHandler(const SpliceReadHandler &r) : SelfHandler(r) {}
+    void operator()(const std::error_code &ec) { self->on_splice_read(ec); }
+  };
+
+  struct SpliceWriteHandler : public SelfHandler<SocketTCP> {
+    using SelfHandler::SelfHandler;
+    SpliceWriteHandler(const SpliceWriteHandler &r) : SelfHandler(r) {}
+    void operator()(const std::error_code &ec) { self->on_splice_write(ec); }
+  };
+
+#endif // __linux__
+
+#ifdef PIPY_USE_IO_URING
+
+  struct UringReceiver : public IOUring::Receiver {
+    SocketTCP* self;
+    UringReceiver(SocketTCP *s) : self(s) {}
+    virtual void on_uring_receive(int result, Data &data, bool more) override { self->on_uring_receive(result, data, more); }
+  };
+
+  struct UringSender : public IOUring::Sender {
+    SocketTCP* self;
+    UringSender(SocketTCP *s) : self(s) {}
+    virtual void on_uring_send(int result) override { self->on_uring_send(result); }
+  };
+
+  IOUring* m_uring = nullptr;
+  UringReceiver m_uring_receiver{this};
+  UringSender m_uring_sender{this};
+
+  void on_uring_receive(int result, Data &data, bool more);
+  void on_uring_send(int result);
+
+#endif // PIPY_USE_IO_URING
+
+  thread_local static size_t s_pinned_size;
+
   static Data::Producer s_dp;
 };
 
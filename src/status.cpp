@@ -27,6 +27,7 @@
 #include "buffer.hpp"
 #include "worker.hpp"
 #include "worker-thread.hpp"
+#include "accept-lb.hpp"
 #include "module.hpp"
 #include "pipeline.hpp"
 #include "graph.hpp"
@@ -66,6 +67,7 @@ public:
     name,
     ip,
     version,
+    pinned,
     modules,
     graph,
     metrics,
@@ -120,6 +122,7 @@ private:
         case Key::timestamp: m_status.timestamp = i; break;
         case Key::since: m_status.since = i; break;
         case Key::version: m_status.version = std::to_string(i); break;
+        case Key::pinned: m_status.pinned = i; break;
         default: break;
       }
     }
@@ -136,6 +139,7 @@ private:
         case Key::timestamp: m_status.timestamp = n; break;
         case Key::since: m_status.since = n; break;
         case Key::version: m_status.version = std::to_string(n); break;
+        case Key::pinned: m_status.pinned = n; break;
         default: break;
       }
     }
@@ -269,6 +273,7 @@ StatusDeserializer::KeyName StatusDeserializer::s_key_names[] = {
   { Key::name, "name" },
   { Key::ip, "ip" },
   { Key::version, "version" },
+  { Key::pinned, "pinned" },
   { Key::modules, "modules" },
   { Key::graph, "graph" },
   { Key::metrics, "metrics" },
@@ -308,6 +313,7 @@ void Status::update_local() {
   buffers.clear();
   inbounds.clear();
   outbounds.clear();
+  threads.clear();
 
   std::map<std::string, std::set<PipelineLayout*>> all_modules;
   PipelineLayout::for_each([&](PipelineLayout *p) {
@@ -440,6 +446,17 @@ void Status::update_local() {
   for (auto &p : outbound_tcp) outbounds.insert(p.second);
   for (auto &p : outbound_udp) outbounds.insert(p.second);
   for (auto &p : outbound_netlink) outbounds.insert(p.second);
+
+  auto load = AcceptLoadBalancer::load();
+  threads.insert({
+    WorkerThread::current()->index(),
+    Inbound::count(),
+    load.lag,
+    load.handoffs_in,
+    load.handoffs_out,
+  });
+
+  pinned = SocketTCP::pinned_size();
 }
 
 template<class T>
@@ -463,6 +480,8 @@ void Status::merge(const Status &other) {
   merge_sets(buffers, other.buffers);
   merge_sets(inbounds, other.inbounds);
   merge_sets(outbounds, other.outbounds);
+  merge_sets(threads, other.threads);
+  pinned += other.pinned;
 }
 
 bool Status::from_json(const Data &data, Data *metrics) {
@@ -495,6 +514,21 @@ void Status::to_json(Data::Builder &db, Data *metrics) const {
   db.push(",\"name\":"); push_str(name);
   db.push(",\"ip\":"); push_str(ip);
   db.push(",\"version\":"); push_str(version);
+  db.push(",\"pinned\":"); push_uint(pinned);
+
+  db.push(",\"threads\":["); first = true;
+  for (const auto &t : threads) {
+    char lag[100];
+    auto len = pjs::Number::to_string(lag, sizeof(lag), t.lag);
+    if (first) first = false; else db.push(',');
+    db.push("{\"index\":"); push_uint(t.index);
+    db.push(",\"connections\":"); push_uint(t.connections);
+    db.push(",\"lag\":"); db.push(lag, len);
+    db.push(",\"handoffsIn\":"); push_uint(t.handoffs_in);
+    db.push(",\"handoffsOut\":"); push_uint(t.handoffs_out);
+    db.push('}');
+  }
+  db.push(']');
 
   db.push(",\"modules\":{"); first = true;
   for (const auto &mod : modules) {
@@ -606,6 +640,10 @@ void Status::dump_buffers(Data::Builder &db) {
       std::to_string(i.size / 1024),
     });
   }
+  rows.push_back({
+    "(Idle socket receive buffers)",
+    std::to_string(pinned / 1024),
+  });
   print_table(db, { "BUFFER", "SIZE(KB)" }, rows);
 }
 
@@ -670,6 +708,22 @@ void Status::dump_outbound(Data::Builder &db) {
   print_table(db, { "OUTBOUND", "PORT", "#CONNECTIONS", "BUFFERED(KB)" }, rows);
 }
 
+void Status::dump_threads(Data::Builder &db) {
+  std::list<std::array<std::string, 5>> rows;
+  for (const auto &t : threads) {
+    char lag[100];
+    std::snprintf(lag, sizeof(lag), "%.3f", t.lag);
+    rows.push_back({
+      std::to_string(t.index),
+      std::to_string(t.connections),
+      lag,
+      std::to_string(t.handoffs_in),
+      std::to_string(t.handoffs_out),
+    });
+  }
+  print_table(db, { "THREAD", "#CONNECTIONS", "LAG(MS)", "#HANDOFFS-IN", "#HANDOFFS-OUT" }, rows);
+}
+
 void Status::dump_json(Data::Builder &db) {
   bool first;
   db.push('{');
@@ -705,7 +759,9 @@ void Status::dump_json(Data::Builder &db) {
     db.push("\":");
     db.push(std::to_string(i.size / 1024));
   }
-  db.push("},\"objects\":{");
+  db.push("},\"pinned\":");
+  db.push(std::to_string(pinned / 1024));
+  db.push(",\"objects\":{");
   first = true;
   for (const auto &i : objects) {
     if (first) first = false; else db.push(',');
@@ -768,6 +824,24 @@ void Status::dump_json(Data::Builder &db) {
     db.push(std::to_string(i.buffered/1024));
     db.push('}');
   }
+  db.push("],\"threads\":[");
+  first = true;
+  for (const auto &t : threads) {
+    char lag[100];
+    std::snprintf(lag, sizeof(lag), "%.3f", t.lag);
+    if (first) first = false; else db.push(',');
+    db.push("{\"index\":");
+    db.push(std::to_string(t.index));
+    db.push(",\"connections\":");
+    db.push(std::to_string(t.connections));
+    db.push(",\"lag\":");
+    db.push(lag);
+    db.push(",\"handoffsIn\":");
+    db.push(std::to_string(t.handoffs_in));
+    db.push(",\"handoffsOut\":");
+    db.push(std::to_string(t.handoffs_out));
+    db.push('}');
+  }
   db.push(']');
   db.push('}');
 }
@@ -187,6 +187,22 @@ public:
     }
   };
 
+  struct ThreadInfo {
+    int index;
+    int connections;
+    double lag;
+    uint64_t handoffs_in;
+    uint64_t handoffs_out;
+
+    bool operator<(const ThreadInfo &r) const {
+      return index < r.index;
+    }
+
+    auto operator+=(const ThreadInfo &r) const -> const ThreadInfo& {
+      return *this;
+    }
+  };
+
   double since = 0;
   double timestamp = 0;
   std::string uuid;
@@ -201,7 +217,9 @@ public:
   std::set<BufferInfo> buffers;
   std::set<InboundInfo> inbounds;
   std::set<OutboundInfo> outbounds;
+  std::set<ThreadInfo> threads;
   std::set<std::string> log_names;
+  size_t pinned = 0;
 
   void update_global();
   void update_local();
@@ -215,6 +233,7 @@ public:
   void dump_pipelines(Data::Builder &db);
   void dump_inbound(Data::Builder &db);
   void dump_outbound(Data::Builder &db);
+  void dump_threads(Data::Builder &db);
   void dump_json(Data::Builder &db);
 };
 
@@ -0,0 +1,537 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "uring.hpp"
+#include "log.hpp"
+
+#ifdef PIPY_USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace pipy {
+
+static Data::Producer s_dp("io_uring");
+
+static inline int sys_io_uring_setup(unsigned entries, io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, 0, 0, nullptr, 0);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void syscall_error(const char *name) {
+  char msg[200];
+  std::snprintf(msg, sizeof(msg), "syscall %s failed with errno = %d: ", name, errno);
+  throw std::runtime_error(std::string(msg) + std::strerror(errno));
+}
+
+static bool kernel_version_at_least(int major, int minor) {
+  utsname name;
+  if (uname(&name)) return false;
+  int a = 0, b = 0;
+  if (std::sscanf(name.release, "%d.%d", &a, &b) != 2) return false;
+  return a > major || (a == major && b >= minor);
+}
+
+//
+// IOUring
+//
+
+IOUring::IOUring(asio::io_context &ctx)
+  : m_io_context(ctx)
+  , m_event(ctx)
+{
+  std::memset(m_buf_blocks, 0, sizeof(m_buf_blocks));
+  try {
+    init();
+  } catch (std::runtime_error &) {
+    cleanup();
+    throw;
+  }
+}
+
+IOUring::~IOUring() {
+  cleanup();
+}
+
+void IOUring::init() {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = CQ_SIZE;
+
+  m_fd = sys_io_uring_setup(SQ_SIZE, &params);
+  if (m_fd < 0) syscall_error("io_uring_setup");
+
+  if (!(params.features & IORING_FEAT_FAST_POLL) || !(params.features & IORING_FEAT_NODROP)) {
+    throw std::runtime_error("kernel does not support io_uring fast poll");
+  }
+
+  // Map the rings
+
+  m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+  if (single_mmap) {
+    m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+  }
+
+  m_sq_ptr = mmap(
+    nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+    m_fd, IORING_OFF_SQ_RING
+  );
+
+  if (m_sq_ptr == MAP_FAILED) {
+    m_sq_ptr = nullptr;
+    syscall_error("mmap");
+  }
+
+  if (single_mmap) {
+    m_cq_ptr = m_sq_ptr;
+  } else {
+    m_cq_ptr = mmap(
+      nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      m_fd, IORING_OFF_CQ_RING
+    );
+    if (m_cq_ptr == MAP_FAILED) {
+      m_cq_ptr = nullptr;
+      syscall_error("mmap");
+    }
+  }
+
+  m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  auto sqes = mmap(
+    nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+    m_fd, IORING_OFF_SQES
+  );
+
+  if (sqes == MAP_FAILED) syscall_error("mmap");
+  m_sqes = (io_uring_sqe *)sqes;
+
+  auto sq = (char *)m_sq_ptr;
+  auto cq = (char *)m_cq_ptr;
+  m_sq_entries = params.sq_entries;
+  m_sq_head = (unsigned *)(sq + params.sq_off.head);
+  m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  m_sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+  m_sq_array = (unsigned *)(sq + params.sq_off.array);
+  m_cq_head = (unsigned *)(cq + params.cq_off.head);
+  m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  m_cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+  m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  // Check for required operations
+
+  const int max_ops = 256;
+  auto probe_size = sizeof(io_uring_probe) + max_ops * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> probe_buf(new char[probe_size]);
+  std::memset(probe_buf.get(), 0, probe_size);
+  auto probe = (io_uring_probe *)probe_buf.get();
+  if (sys_io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, max_ops) < 0) {
+    syscall_error("io_uring_register");
+  }
+
+  for (const auto op : { IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_ASYNC_CANCEL }) {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      throw std::runtime_error("kernel does not support required io_uring operations");
+    }
+  }
+
+  // Completion notification through an eventfd watched by asio
+
+  int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd < 0) syscall_error("eventfd");
+  m_event.assign(efd);
+
+  if (sys_io_uring_register(m_fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+    syscall_error("io_uring_register");
+  }
+
+  init_buffer_ring();
+}
+
+void IOUring::cleanup() {
+  std::error_code ec;
+  m_event.close(ec);
+  if (m_sqes) munmap(m_sqes, m_sqes_size);
+  if (m_cq_ptr && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_size);
+  if (m_sq_ptr) munmap(m_sq_ptr, m_sq_size);
+  if (m_fd >= 0) close(m_fd);
+  if (m_buf_ring) munmap(m_buf_ring, BUFFER_RING_SIZE * sizeof(io_uring_buf));
+  for (auto &b : m_buf_blocks) { delete b; b = nullptr; }
+  m_sqes = nullptr;
+  m_cq_ptr = nullptr;
+  m_sq_ptr = nullptr;
+  m_buf_ring = nullptr;
+  m_fd = -1;
+}
+
+//
+// Receives pick their buffers from a ring of provided buffers (Linux 5.19+),
+// so no memory is tied up by sockets that are waiting for data. Each buffer
+// in the ring is the memory of a Data::Block, so that received bytes become
+// Data without copying. Multishot receive also needs Linux 6.0+.
+//
+
+void IOUring::init_buffer_ring() {
+#ifdef IORING_RECV_MULTISHOT
+  if (!kernel_version_at_least(5, 19)) return;
+
+  auto size = BUFFER_RING_SIZE * sizeof(io_uring_buf);
+  auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (ptr == MAP_FAILED) return;
+
+  io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)ptr;
+  reg.ring_entries = BUFFER_RING_SIZE;
+  reg.bgid = BUFFER_GROUP;
+
+  if (sys_io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    munmap(ptr, size);
+    return;
+  }
+
+  m_buf_ring = (io_uring_buf_ring *)ptr;
+  m_buf_tail = 0;
+  for (unsigned i = 0; i < BUFFER_RING_SIZE; i++) {
+    m_buf_blocks[i] = new Data::Block(&s_dp);
+    provide_buffer(i);
+  }
+  __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+  m_buffer_select = true;
+  m_multishot = kernel_version_at_least(6, 0);
+#endif // IORING_RECV_MULTISHOT
+}
+
+void IOUring::provide_buffer(unsigned bid) {
+  auto block = m_buf_blocks[bid];
+  // The ring entries start at offset 0, overlaying the tail field. Not using
+  // io_uring_buf_ring::bufs here since its flexible-array declaration gets an
+  // extra leading member when compiled as C++, which shifts the entries.
+  auto bufs = (io_uring_buf *)m_buf_ring;
+  auto &buf = bufs[m_buf_tail & (BUFFER_RING_SIZE - 1)];
+  buf.addr = (uint64_t)block->ptr();
+  buf.len = block->size();
+  buf.bid = bid;
+  m_buf_tail++;
+}
+
+void IOUring::take_buffer(unsigned bid, int size, Data &data) {
+  if (bid >= BUFFER_RING_SIZE) return;
+  auto block = m_buf_blocks[bid];
+  if (size > 0) block->to_data(data, 0, size);
+  delete block;
+  m_buf_blocks[bid] = new Data::Block(&s_dp);
+  provide_buffer(bid);
+  __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+void IOUring::receive(int fd, Receiver *receiver) {
+  receiver->m_fd = fd;
+  receiver->m_buffer_select = m_buffer_select;
+  receiver->m_multishot = m_multishot;
+  submit(receiver);
+}
+
+void IOUring::send(int fd, const Data &data, Sender *sender) {
+  auto &msg = sender->m_msg;
+  auto *iov = sender->m_iov;
+  int n = 0;
+  for (const auto c : data.chunks()) {
+    if (n >= Sender::MAX_IOV) break;
+    iov[n].iov_base = std::get<0>(c);
+    iov[n].iov_len = std::get<1>(c);
+    n++;
+  }
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = n;
+  sender->m_fd = fd;
+  submit(sender);
+}
+
+void IOUring::cancel(Request *request) {
+  if (request->m_ring != this) return;
+  if (request->m_canceled) return;
+  request->m_canceled = true;
+
+  // Still in the backlog, never reached the kernel
+  for (auto **p = &m_backlog_head; *p; p = &(*p)->m_next) {
+    if (*p == request) {
+      *p = request->m_next;
+      if (m_backlog_tail == request) {
+        m_backlog_tail = nullptr;
+        for (auto r = m_backlog_head; r; r = r->m_next) m_backlog_tail = r;
+      }
+      request->m_next = nullptr;
+      asio::post(m_io_context, [=]() { complete(request, -ECANCELED, 0); });
+      return;
+    }
+  }
+
+  // The request may still sit in the SQ ring naming a raw fd that
+  // is about to be closed and reused, so push it into the kernel
+  // right away along with its cancelation, before close() returns
+  if (auto sqe = IOUring::sqe()) {
+    prepare_cancel(sqe, request);
+  } else {
+    m_cancels.push_back(request);
+    schedule_flush();
+  }
+  enter();
+}
+
+void IOUring::prepare_cancel(io_uring_sqe *sqe, Request *request) {
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uint64_t)request;
+  sqe->user_data = 0;
+}
+
+void IOUring::enter() {
+  if (m_sq_pending > 0) {
+    auto n = sys_io_uring_enter(m_fd, m_sq_pending);
+    if (n > 0) {
+      m_sq_pending -= n;
+    } else if (n < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR) {
+      Log::error("[io_uring] io_uring_enter failed: %s", std::strerror(errno));
+    }
+  }
+}
+
+auto IOUring::sqe() -> io_uring_sqe* {
+  auto tail = *m_sq_tail;
+  if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+    if (m_sq_pending > 0) {
+      auto n = sys_io_uring_enter(m_fd, m_sq_pending);
+      if (n > 0) m_sq_pending -= n;
+    }
+    if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+      return nullptr;
+    }
+  }
+  auto i = tail & m_sq_mask;
+  auto sqe = &m_sqes[i];
+  std::memset(sqe, 0, sizeof(*sqe));
+  m_sq_array[i] = i;
+  __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+  m_sq_pending++;
+  return sqe;
+}
+
+void IOUring::submit(Request *request) {
+  request->m_ring = this;
+  request->m_canceled = false;
+  m_inflight++;
+  if (!m_backlog_head) {
+    if (auto sqe = IOUring::sqe()) {
+      request->prepare(sqe);
+      sqe->user_data = (uint64_t)request;
+      schedule_flush();
+      return;
+    }
+  }
+  request->m_next = nullptr;
+  if (m_backlog_tail) {
+    m_backlog_tail->m_next = request;
+  } else {
+    m_backlog_head = request;
+  }
+  m_backlog_tail = request;
+  schedule_flush();
+}
+
+//
+// Submissions made while handling one round of events are
+// pushed to the kernel all at once by a single io_uring_enter()
+//
+
+void IOUring::schedule_flush() {
+  if (m_flushing) return;
+  m_flushing = true;
+  asio::post(m_io_context, [this]() {
+    m_flushing = false;
+    flush();
+  });
+}
+
+void IOUring::flush() {
+  while (auto r = m_backlog_head) {
+    auto sqe = IOUring::sqe();
+    if (!sqe) break;
+    m_backlog_head = r->m_next;
+    if (!m_backlog_head) m_backlog_tail = nullptr;
+    r->m_next = nullptr;
+    r->prepare(sqe);
+    sqe->user_data = (uint64_t)r;
+  }
+
+  while (!m_cancels.empty()) {
+    auto sqe = IOUring::sqe();
+    if (!sqe) break;
+    prepare_cancel(sqe, m_cancels.back());
+    m_cancels.pop_back();
+  }
+
+  enter();
+
+  if (m_sq_pending > 0 || m_backlog_head || !m_cancels.empty()) {
+    reap();
+    schedule_flush();
+  }
+
+  wait();
+}
+
+void IOUring::wait() {
+  if (m_waiting || !m_inflight) return;
+  m_waiting = true;
+  m_event.async_wait(
+    asio::posix::stream_descriptor::wait_read,
+    [this](const std::error_code &ec) {
+      m_waiting = false;
+      if (ec) return;
+      uint64_t n;
+      auto ret = ::read(m_event.native_handle(), &n, sizeof(n));
+      (void)ret;
+      reap();
+      wait();
+    }
+  );
+
+  // Completions posted before the wait was armed will not
+  // trigger the eventfd again, so check for them right now
+  if (*m_cq_head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+    asio::post(m_io_context, [this]() { reap(); wait(); });
+  }
+}
+
+void IOUring::reap() {
+  auto head = *m_cq_head;
+  for (;;) {
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) break;
+    const auto &cqe = m_cqes[head & m_cq_mask];
+    auto request = (Request *)cqe.user_data;
+    auto result = cqe.res;
+    auto flags = cqe.flags;
+    __atomic_store_n(m_cq_head, ++head, __ATOMIC_RELEASE);
+    if (request) complete(request, result, flags);
+  }
+}
+
+void IOUring::complete(Request *request, int result, unsigned flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    m_inflight--;
+    if (request->m_canceled) {
+      for (auto i = m_cancels.begin(); i != m_cancels.end(); i++) {
+        if (*i == request) {
+          m_cancels.erase(i);
+          break;
+        }
+      }
+    }
+  }
+  request->on_complete(result, flags);
+}
+
+//
+// IOUring::Receiver
+//
+
+void IOUring::Receiver::prepare(io_uring_sqe *sqe) {
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = m_fd;
+  if (m_buffer_select) {
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+#ifdef IORING_RECV_MULTISHOT
+    if (m_multishot) sqe->ioprio = IORING_RECV_MULTISHOT;
+#endif
+    return;
+  }
+  m_buffer.clear();
+  m_buffer.push(Data(RECEIVE_BUFFER_SIZE, &s_dp));
+  auto c = *m_buffer.chunks().begin();
+  sqe->addr = (uint64_t)std::get<0>(c);
+  sqe->len = std::get<1>(c);
+}
+
+void IOUring::Receiver::on_complete(int result, unsigned flags) {
+  bool more = (flags & IORING_CQE_F_MORE);
+  Data data;
+  if (m_buffer_select) {
+    if (flags & IORING_CQE_F_BUFFER) {
+      m_ring->take_buffer(flags >> IORING_CQE_BUFFER_SHIFT, result, data);
+    }
+    if (result == -ENOBUFS && !more) {
+      // Running out of buffers is no error of the socket: try
+      // again, or end quietly if the receive is being canceled
+      if (!m_canceled) {
+        m_ring->submit(this);
+        return;
+      }
+      result = -ECANCELED;
+    }
+  } else if (result > 0) {
+    m_buffer.pop(m_buffer.size() - result);
+    data.push(std::move(m_buffer));
+  } else {
+    m_buffer.clear();
+  }
+  on_uring_receive(result, data, more);
+}
+
+//
+// IOUring::Sender
+//
+
+void IOUring::Sender::prepare(io_uring_sqe *sqe) {
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = m_fd;
+  sqe->addr = (uint64_t)&m_msg;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+} // namespace pipy
+
+#endif // PIPY_USE_IO_URING
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef URING_HPP
+#define URING_HPP
+
+#include "net.hpp"
+#include "data.hpp"
+
+#ifdef PIPY_USE_IO_URING
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace pipy {
+
+//
+// IOUring
+//
+
+class IOUring {
+public:
+  IOUring(asio::io_context &ctx);
+  ~IOUring();
+
+  //
+  // IOUring::Request
+  //
+
+  class Request {
+  protected:
+    virtual void on_complete(int result, unsigned flags) = 0;
+
+  private:
+    virtual void prepare(io_uring_sqe *sqe) = 0;
+
+    IOUring* m_ring = nullptr;
+    Request* m_next = nullptr;
+    int m_fd = -1;
+    bool m_canceled = false;
+
+    friend class IOUring;
+  };
+
+  //
+  // IOUring::Receiver
+  //
+
+  class Receiver : public Request {
+  public:
+    bool multishot() const { return m_multishot; }
+    bool pinned() const { return !m_buffer_select; }
+
+  protected:
+
+    // result is the number of bytes received, 0 on EOF or -errno on error
+    virtual void on_uring_receive(int result, Data &data, bool more) = 0;
+
+  private:
+    Data m_buffer;
+    bool m_buffer_select = false;
+    bool m_multishot = false;
+
+    virtual void prepare(io_uring_sqe *sqe) override;
+    virtual void on_complete(int result, unsigned flags) override;
+
+    friend class IOUring;
+  };
+
+  //
+  // IOUring::Sender
+  //
+
+  class Sender : public Request {
+  protected:
+
+    // result is the number of bytes sent or -errno on error
+    virtual void on_uring_send(int result) = 0;
+
+  private:
+    static const int MAX_IOV = 64;
+
+    msghdr m_msg;
+    iovec m_iov[MAX_IOV];
+
+    virtual void prepare(io_uring_sqe *sqe) override;
+    virtual void on_complete(int result, unsigned flags) override { on_uring_send(result); }
+
+    friend class IOUring;
+  };
+
+  void receive(int fd, Receiver *receiver);
+  void send(int fd, const Data &data, Sender *sender);
+  void cancel(Request *request);
+
+private:
+  static const unsigned SQ_SIZE = 1024;
+  static const unsigned CQ_SIZE = 4096;
+  static const unsigned BUFFER_RING_SIZE = 256;
+  static const unsigned BUFFER_GROUP = 0;
+
+  asio::io_context& m_io_context;
+  asio::posix::stream_descriptor m_event;
+  int m_fd = -1;
+  void* m_sq_ptr = nullptr;
+  void* m_cq_ptr = nullptr;
+  size_t m_sq_size = 0;
+  size_t m_cq_size = 0;
+  io_uring_sqe* m_sqes = nullptr;
+  size_t m_sqes_size = 0;
+  unsigned m_sq_entries = 0;
+  unsigned* m_sq_head = nullptr;
+  unsigned* m_sq_tail = nullptr;
+  unsigned* m_sq_array = nullptr;
+  unsigned m_sq_mask = 0;
+  unsigned m_sq_pending = 0;
+  unsigned* m_cq_head = nullptr;
+  unsigned* m_cq_tail = nullptr;
+  io_uring_cqe* m_cqes = nullptr;
+  unsigned m_cq_mask = 0;
+  io_uring_buf_ring* m_buf_ring = nullptr;
+  Data::Block* m_buf_blocks[BUFFER_RING_SIZE];
+  uint16_t m_buf_tail = 0;
+  Request* m_backlog_head = nullptr;
+  Request* m_backlog_tail = nullptr;
+  std::vector<Request*> m_cancels;
+  int m_inflight = 0;
+  bool m_buffer_select = false;
+  bool m_multishot = false;
+  bool m_flushing = false;
+  bool m_waiting = false;
+
+  void init();
+  void cleanup();
+  void init_buffer_ring();
+  void provide_buffer(unsigned bid);
+  void take_buffer(unsigned bid, int size, Data &data);
+  auto sqe() -> io_uring_sqe*;
+  void submit(Request *request);
+  void prepare_cancel(io_uring_sqe *sqe, Request *request);
+  void enter();
+  void schedule_flush();
+  void flush();
+  void wait();
+  void reap();
+  void complete(Request *request, int result, unsigned flags);
+};
+
+} // namespace pipy
+
+#endif // PIPY_USE_IO_URING
+
+#endif // URING_HPP
@@ -24,6 +24,7 @@
  */
 
 #include "worker-thread.hpp"
+#include "accept-lb.hpp"
 #include "worker.hpp"
 #include "codebase.hpp"
 #include "pipeline-lb.hpp"
@@ -76,8 +77,10 @@ bool WorkerThread::start(bool force) {
 }
 
 void WorkerThread::status(Status &status, const std::function<void()> &cb) {
+  auto posted = AcceptLoadBalancer::now();
   m_net->post(
-    [&, cb]() {
+    [&, cb, posted]() {
+      AcceptLoadBalancer::measure(m_index, posted);
       status.update_local();
       status.version = m_version;
       cb();
@@ -86,8 +89,10 @@ void WorkerThread::status(Status &status, const std::function<void()> &cb) {
 }
 
 void WorkerThread::status(const std::function<void(Status&)> &cb) {
+  auto posted = AcceptLoadBalancer::now();
   m_net->post(
     [=]() {
+      AcceptLoadBalancer::measure(m_index, posted);
       m_status.update_local();
       m_status.version = m_version;
       cb(m_status);
@@ -112,16 +117,6 @@ void WorkerThread::stats(stats::MetricData &metric_data, const std::vector<std::
   );
 }
 
-void WorkerThread::stats(stats::MetricData &metric_data, const std::function<void()> &cb) {
-  m_net->post(
-    [&, cb]() {
-      stats::Metric::local().collect();
-      metric_data.update(stats::Metric::local());
-      cb();
-    }
-  );
-}
-
 void WorkerThread::stats(const std::function<void(stats::MetricData&)> &cb) {
   m_net->post(
     [=]() {
@@ -509,6 +504,7 @@ void WorkerThread::main() {
     Log::debug(Log::THREAD, "[thread] Thread %d started", m_index);
 
     init_metrics();
+    AcceptLoadBalancer::register_thread(m_index);
 
     m_working = true;
     while (m_working) {
@@ -537,6 +533,7 @@ void WorkerThread::main() {
       }
     }
 
+    AcceptLoadBalancer::unregister_thread();
     Log::debug(Log::THREAD, "[thread] Thread %d ended", m_index);
 
   } else {
@@ -674,14 +671,16 @@ auto WorkerManager::stats() -> stats::MetricDataSum& {
     if (auto n = m_worker_threads.size()) {
       std::mutex m;
       std::condition_variable cv;
-      pjs::vl_array<stats::MetricData, 256> metric_data(n);
+      pjs::vl_array<stats::MetricData*, 256> metric_data(n);
 
+      // Keep to the same MetricData on every worker so that
+      // unchanged metrics are only copied and summed by value
       for (auto *wt : m_worker_threads) {
         auto i = wt->index();
         wt->stats(
-          metric_data[i],
-          [&]() {
+          [&, i](stats::MetricData &data) {
             std::lock_guard<std::mutex> lock(m);
+            metric_data[i] = &data;
             n--;
             cv.notify_one();
           }
@@ -692,7 +691,7 @@ auto WorkerManager::stats() -> stats::MetricDataSum& {
       cv.wait(lock, [&]{ return n == 0; });
 
       for (auto i = 0; i < m_worker_threads.size(); i++) {
-        m_metric_data_sum.sum(metric_data[i], i == 0);
+        m_metric_data_sum.sum(*metric_data[i], i == 0);
       }
     }
 
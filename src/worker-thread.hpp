@@ -68,7 +68,6 @@ public:
   void status(Status &status, const std::function<void()> &cb);
   void status(const std::function<void(Status&)> &cb);
   void stats(stats::MetricData &metric_data, const std::vector<std::string> &names, const std::function<void()> &cb);
-  void stats(stats::MetricData &metric_data, const std::function<void()> &cb);
   void stats(const std::function<void(stats::MetricData&)> &cb);
   void stats(const std::vector<std::string> &names, const std::function<void(stats::MetricData&)> &cb);
   void dump_objects(const std::string &class_name, std::map<std::string, size_t> &counts, const std::function<void()> &cb);
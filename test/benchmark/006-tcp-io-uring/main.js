@@ -0,0 +1,4 @@
+pipy()
+
+.listen(os.env.LISTEN || 8000)
+.connect('localhost:8080')
@@ -0,0 +1,22 @@
+//
+// Consistent hashing lookup cost: every request
+// looks up 100 keys among 100 weighted targets
+//
+
+var targets = Object.fromEntries(
+  new Array(100).fill().map((_, i) => [`10.0.${i >> 4}.${i & 15}:8080`, 1 + (i % 3)])
+)
+
+var lb = new algo.HashingLoadBalancer(targets, null, { algorithm: os.env.ALGORITHM || 'maglev' })
+var keys = new Array(100).fill().map((_, i) => `session-${i}`)
+
+pipy.listen(os.env.LISTEN || 8000, $=>$
+  .demuxHTTP().to($=>$
+    .handleMessageStart(
+      () => keys.forEach(k => lb.select(k))
+    )
+    .muxHTTP().to($=>$
+      .connect('localhost:8080')
+    )
+  )
+)
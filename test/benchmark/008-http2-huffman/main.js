@@ -0,0 +1,37 @@
+//
+// HPACK decoding cost: every request gets browser-like headers and
+// goes over HTTP/2 to a second listener in this same process, with
+// dynamic-table indexing off so that pipy's own HeaderDecoder has
+// to decode every header as a Huffman-coded literal
+//
+
+var upstream = (os.env.UPSTREAM_PORT | 0) || 8600
+
+var headers = {
+  'user-agent': 'Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36',
+  'accept': 'text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8',
+  'accept-language': 'en-US,en;q=0.9',
+  'accept-encoding': 'gzip, deflate, br',
+  'cache-control': 'max-age=0',
+  'referer': 'https://www.example.com/products/catalog/index.html?page=2&sort=price',
+  'x-request-id': 'a8098c1a-f86e-11da-bd1a-00112444be1e',
+}
+
+var response = new Message('hello')
+
+pipy.listen(os.env.LISTEN || 8000, $=>$
+  .demuxHTTP().to($=>$
+    .handleMessageStart(
+      msg => Object.assign(msg.head.headers, headers)
+    )
+    .muxHTTP(() => 1, { version: 2, headerIndexing: false }).to($=>$
+      .connect(`localhost:${upstream}`)
+    )
+  )
+)
+
+pipy.listen(upstream, $=>$
+  .demuxHTTP().to($=>$
+    .replaceMessage(response)
+  )
+)
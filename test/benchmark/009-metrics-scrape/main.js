@@ -0,0 +1,51 @@
+//
+// Metrics scrape cost against series count: every request increases
+// one of the labelled counters, while the first thread scrapes
+// /metrics from the admin port every second and doubles the number
+// of series after every 3 scrapes, from 1000 up to SERIES, so both
+// the first scrape after new series and the ones after are timed
+//
+
+var maxSeries = (os.env.SERIES | 0) || 64000
+var admin = os.env.ADMIN || 'localhost:6060'
+
+var counter = new stats.Counter('bench_requests', ['route', 'status'])
+var routes = []
+
+var grow = n => new Array(Math.max(0, n - routes.length)).fill().forEach(
+  () => {
+    var r = `/route/${routes.length}`
+    counter.withLabels(r, '200').zero()
+    routes.push(r)
+  }
+)
+
+grow(1000)
+
+var n = 0
+
+pipy.listen(os.env.LISTEN || 8000, $=>$
+  .demuxHTTP().to($=>$
+    .handleMessageStart(
+      () => counter.withLabels(routes[n++ % routes.length], '200').increase()
+    )
+    .muxHTTP().to($=>$
+      .connect('localhost:8080')
+    )
+  )
+)
+
+if (pipy.thread.id === 0) {
+  var agent = new http.Agent(admin)
+  var scrapes = 0
+  var scrape = () => new Timeout(1).wait().then(() => {
+    var t = pipy.now()
+    return agent.request('GET', '/metrics').then(
+      res => {
+        console.info(`Scraped ${routes.length} series x ${pipy.thread.concurrency} threads, ${res.body.size} bytes in ${(pipy.now() - t).toFixed(1)}ms`)
+        if (++scrapes % 3 === 0) grow(Math.min(routes.length * 2, maxSeries))
+      }
+    )
+  }).then(scrape)
+  scrape()
+}
@@ -0,0 +1,29 @@
+//
+// HTTP proxy with accepted connections moved to the least loaded
+// worker thread, while the first thread prints the per-thread load
+// reported by /api/v1/status every second
+//
+
+var admin = os.env.ADMIN || 'localhost:6060'
+
+pipy.listen(os.env.LISTEN || 8000, $=>$
+  .demuxHTTP().to($=>$
+    .muxHTTP().to($=>$
+      .connect('localhost:8080')
+    )
+  )
+)
+
+if (pipy.thread.id === 0) {
+  var agent = new http.Agent(admin)
+  var report = () => new Timeout(1).wait().then(
+    () => agent.request('GET', '/api/v1/status').then(
+      res => console.info(
+        JSON.decode(res.body).threads.map(
+          t => `#${t.index}: ${t.connections} conns, lag ${t.lag}ms, ${t.handoffsIn} in, ${t.handoffsOut} out`
+        ).join(' | ')
+      )
+    )
+  ).then(report)
+  report()
+}
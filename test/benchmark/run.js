@@ -31,6 +31,12 @@ fs.readdirSync(currentDir, { withFileTypes: true })
     if (!isNaN(n)) allTests[n] = ent.name;
   });
 
+function testOptions(name) {
+  const path = join(currentDir, name, 'options');
+  if (!fs.existsSync(path)) return [];
+  return fs.readFileSync(path, 'utf8').split(/\s+/).filter(s => s);
+}
+
 async function summary() {
   const sysinfo = [];
   const collectSysinfo = (info, depth) => {
@@ -110,7 +116,7 @@ async function start(id) {
         const port = 8000 + (i|0);
         const path = join(currentDir, name, 'main.js');
         log('Starting', chalk.magenta(name), '...');
-        procs.push(await startPipy([ path ], { LISTEN: `0.0.0.0:${port}` }));
+        procs.push(await startPipy([ ...testOptions(name), path ], { LISTEN: `0.0.0.0:${port}` }));
       }
 
       await benchmark('baseline', 8000);
@@ -127,7 +133,7 @@ async function start(id) {
       const name = allTests[id];
       const path = join(currentDir, name, 'main.js');
       log('Starting', chalk.magenta(name), '...');
-      procs.push(await startPipy([ path ], { LISTEN: '0.0.0.0:8001' }));
+      procs.push(await startPipy([ ...testOptions(name), path ], { LISTEN: '0.0.0.0:8001' }));
       await benchmark('baseline', 8000);
       await benchmark(name, 8001);
       await summary();
@@ -0,0 +1,71 @@
+((
+  keys = new Array(10000).fill().map((_, i) => `key-${i}`),
+
+  targets = (n, skip) => Object.fromEntries(
+    new Array(n).fill().map((_, i) => i + 1).filter(i => i !== skip).map(i => [`10.0.0.${i}:8080`, 1])
+  ),
+
+  assign = lb => keys.map(k => lb.select(k)),
+
+  moved = (a, b) => a.filter((t, i) => t !== b[i]).length / a.length,
+
+  report = (name, ok, value) => println(`${name}: ${ok ? 'ok' : `FAIL (${(value * 100).toFixed(2)}%)`}`),
+
+  // Keys moved between targets other than the one added or removed:
+  // none on a ring, a small fraction with Maglev
+  test = (algorithm, tolerance) => {
+    var lb = new algo.HashingLoadBalancer(targets(10), null, { algorithm })
+    var a = assign(lb)
+
+    // Every target gets roughly a tenth of all keys
+    var counts = {}
+    a.forEach(t => counts[t] = (counts[t] || 0) + 1)
+    var spread = Object.values(counts).reduce((a, n) => Math.max(a, Math.abs(n - 1000) / 1000), 0)
+    report(`${algorithm} balance`, Object.keys(counts).length === 10 && spread < 0.25, spread)
+
+    // Adding an 11th target moves about 1/11 of the keys
+    lb.set(targets(11))
+    var b = assign(lb)
+    var m = moved(a, b)
+    report(`${algorithm} add target`, m < 1/11 * 1.5, m)
+    m = b.filter((t, i) => t !== a[i] && t !== '10.0.0.11:8080').length / keys.length
+    report(`${algorithm} add target disruption`, m <= tolerance, m)
+
+    // Removing one target only moves the keys that were on it
+    lb.set(targets(10, 5))
+    var c = assign(lb)
+    m = moved(a, c)
+    report(`${algorithm} remove target`, m < 1/10 * 1.5, m)
+    m = c.filter((t, i) => t !== a[i] && a[i] !== '10.0.0.5:8080').length / keys.length
+    report(`${algorithm} remove target disruption`, m <= tolerance, m)
+
+    // Restoring the original targets restores every key
+    lb.set(targets(10))
+    m = moved(a, assign(lb))
+    report(`${algorithm} restore`, m === 0, m)
+
+    // Unhealthy targets are skipped without moving other keys
+    var unhealthy = new algo.Cache
+    unhealthy.set('10.0.0.3:8080', true)
+    var d = keys.map(k => lb.select(k, unhealthy))
+    report(`${algorithm} unhealthy`, d.every((t, i) => t !== '10.0.0.3:8080' && (t === a[i] || a[i] === '10.0.0.3:8080')), moved(a, d))
+
+    // Weights are honored
+    lb = new algo.HashingLoadBalancer({ 'a': 1, 'b': 3 }, null, { algorithm })
+    var share = assign(lb).filter(t => t === 'b').length / keys.length
+    report(`${algorithm} weights`, Math.abs(share - 0.75) < 0.05, share)
+  },
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    test('ring', 0),
+    test('maglev', 0.02),
+    pipy.exit(),
+    new StreamEnd
+  )
+)
+
+)()
@@ -0,0 +1,87 @@
+((
+  report = (name, ok, value) => println(`${name}: ${ok ? 'ok' : `FAIL (${(value * 100).toFixed(2)}%)`}`),
+
+  share = (results, target) => results.filter(t => t === target).length / results.length,
+
+  // Allocate without ever freeing: outstanding work follows the weights
+  testSaturated = (algorithm) => {
+    var lb = new algo.LoadBalancer(['a', 'b'], { algorithm, weight: t => t === 'b' ? 3 : 1 })
+    var results = new Array(4000).fill().map(() => lb.allocate().target)
+    var s = share(results, 'b')
+    report(`${algorithm} saturated weights`, Math.abs(s - 0.75) < 0.03, s)
+  },
+
+  // Allocate and free one at a time: picks follow the weights
+  testSequential = (algorithm) => {
+    var lb = new algo.LoadBalancer(['a', 'b'], { algorithm, weight: t => t === 'b' ? 3 : 1 })
+    var results = new Array(4000).fill().map(() => {
+      var r = lb.allocate()
+      r.free()
+      return r.target
+    })
+    var s = share(results, 'b')
+    report(`${algorithm} sequential weights`, Math.abs(s - 0.75) < 0.05, s)
+  },
+
+  // Targets rejected by the validator are never picked
+  testValidator = (algorithm) => {
+    var lb = new algo.LoadBalancer(['a', 'b', 'c', 'd'], { algorithm })
+    var results = new Array(1000).fill().map(() => lb.allocate(undefined, t => t === 'c').target)
+    report(`${algorithm} validator`, results.every(t => t === 'c'), 1 - share(results, 'c'))
+  },
+
+  // Keep a fixed number of requests in flight against upstreams of
+  // different latencies and count where they end up
+  simulate = (algorithm, latencies, concurrency, total) => new Promise(
+    resolve => {
+      var lb = new algo.LoadBalancer(Object.keys(latencies), { algorithm, latencyDecay: 1 })
+      var results = []
+      var started = 0
+      var next = () => {
+        if (started >= total) {
+          if (results.length === total) resolve(results)
+          return
+        }
+        started++
+        var r = lb.allocate()
+        new Timeout(latencies[r.target]).wait().then(() => {
+          r.free()
+          results.push(r.target)
+          next()
+        })
+      }
+      new Array(concurrency).fill().forEach(next)
+    }
+  ),
+
+  latencies = { 'fast-1': 0.005, 'fast-2': 0.005, 'fast-3': 0.005, 'slow': 0.05 },
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    testSaturated('power-of-two'),
+    testSequential('power-of-two'),
+    testValidator('power-of-two'),
+    testValidator('peak-ewma'),
+
+    // Least outstanding requests already keeps work off the slow upstream,
+    // peak EWMA also learns its latency and sends it almost nothing
+    simulate('power-of-two', latencies, 8, 800).then(
+      results => (
+        ((s) => report('power-of-two slow upstream', s < 0.15, s))(share(results, 'slow'))
+      )
+    ).then(
+      () => simulate('peak-ewma', latencies, 8, 800)
+    ).then(
+      results => (
+        ((s) => report('peak-ewma slow upstream', s < 0.05, s))(share(results, 'slow')),
+        pipy.exit()
+      )
+    ),
+    new StreamEnd
+  )
+)
+
+)()
@@ -0,0 +1,60 @@
+((
+  report = (name, ok, value) => println(`${name}: ${ok ? 'ok' : `FAIL (${value})`}`),
+
+  // Deterministic samples from a linear congruential generator
+  random = ((seed) => () => (seed = (seed * 48271) % 2147483647) / 2147483647)(12345),
+
+  samples = new Array(20000).fill().map(() => Math.exp(random() * 16 - 8)),
+
+  // Bucket counts by scanning every bucket for every sample
+  reference = (buckets) => {
+    var counts = buckets.map(() => 0)
+    samples.forEach(x => {
+      var i = buckets.findIndex(b => x <= b)
+      if (i >= 0) counts[i]++
+    })
+    return counts
+  },
+
+  testBuckets = (name, buckets) => {
+    var h = new stats.Histogram(`test_${name}`, buckets)
+    samples.forEach(x => h.observe(x))
+    h.observe(NaN)
+    samples.forEach(x => buckets.forEach(b => h.observe(b)))
+    var counts = h.value.slice(0, buckets.length)
+    var expected = reference(buckets).map((n, i) => n + samples.length)
+    var diff = counts.findIndex((n, i) => n !== expected[i])
+    report(`${name} buckets`, diff < 0, `bucket #${diff}`)
+  },
+
+  // Every percentile of a sketch is close to the exact one
+  testSketch = (relativeError) => {
+    var p = new algo.Percentile({ min: 0.0001, max: 10000, relativeError })
+    samples.forEach(x => p.observe(x))
+    var sorted = samples.slice().sort((a, b) => a - b)
+    var worst = [1, 10, 25, 50, 75, 90, 99].reduce(
+      (worst, n) => {
+        var exact = sorted[Math.ceil(sorted.length * n / 100) - 1]
+        return Math.max(worst, Math.abs(p.calculate(n) - exact) / exact)
+      }, 0
+    )
+    report(`sketch error ${relativeError}`, worst <= relativeError, worst)
+  },
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    testBuckets('linear', new Array(40).fill().map((_, i) => (i + 1) * 25)),
+    testBuckets('uneven', [0.001, 0.01, 0.05, 0.1, 0.3, 1, 2, 5, 7, 10, 30, 100, 1000]),
+    testBuckets('geometric', new Array(30).fill().map((_, i) => Math.pow(2, i - 12)).concat([Infinity])),
+    testBuckets('log-spaced', new Array(111).fill().map((_, i) => 0.001 * Math.pow(1.05 / 0.95, i)).concat([Infinity])),
+    testSketch(0.05),
+    testSketch(0.01),
+    pipy.exit(),
+    new StreamEnd
+  )
+)
+
+)()